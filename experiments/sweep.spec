@@ -0,0 +1,6 @@
+# Experiment sweep, see src/sweep.h
+map = ./experiments/D5.bmp ./experiments/E5.bmp
+#map = ./experiments/D1.bmp ./experiments/D2.bmp ./experiments/D3.bmp ./experiments/D4.bmp ./experiments/D5.bmp ./experiments/D5-3.bmp ./experiments/D5-4.bmp ./experiments/E1.bmp ./experiments/E2.bmp ./experiments/E3.bmp ./experiments/E4.bmp ./experiments/E5.bmp
+people = 500
+smoke = 3
+runs = 1
@@ -0,0 +1,147 @@
+/**
+ * @file accumulator.cpp
+ * Mergeable streaming accumulator implementation.
+ */
+
+#include <cmath>
+#include <algorithm>
+
+#include "accumulator.h"
+
+using namespace Evacuation;
+
+/// Histogram buckets per unit below the logarithmic range.
+static constexpr double resolution = 32.0;
+/// Sub-buckets per octave.
+static constexpr size_t octave = 32;
+/// Number of linear buckets (values below 2).
+static constexpr size_t linear = 64;
+
+/// Two-sided 95 % Student t quantiles for 1..30 degrees of freedom.
+static const double student_t[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+size_t Accumulator::bucket(double x) {
+    double v = std::max(x, 0.0) * resolution;
+    if (v < linear) {
+        return v;
+    }
+    int e = std::ilogb(v);
+    double mantissa = std::scalbn(v, -e);
+    return linear + (e - std::ilogb((double) linear)) * octave
+        + (size_t) ((mantissa - 1.0) * octave);
+}
+
+double Accumulator::bucket_value(size_t index) {
+    if (index < linear) {
+        return (index + 0.5) / resolution;
+    }
+    size_t e = std::ilogb((double) linear) + (index - linear) / octave;
+    size_t sub = (index - linear) % octave;
+    return std::scalbn(1.0 + (sub + 0.5) / octave, e) / resolution;
+}
+
+void Accumulator::push(double x) {
+    n++;
+    double delta = x - mu;
+    mu += delta / n;
+    m2 += delta * (x - mu);
+    lo = n == 1 ? x : std::min(lo, x);
+    hi = n == 1 ? x : std::max(hi, x);
+
+    reserve(x);
+    buckets[bucket(x)]++;
+}
+
+void Accumulator::reserve(double x) {
+    size_t b = bucket(x);
+    if (b >= buckets.size()) {
+        buckets.resize(std::max(b + 1 + octave, 2 * buckets.size()));
+    }
+}
+
+void Accumulator::merge(const Accumulator &other) {
+    if (other.n == 0) {
+        return;
+    }
+    if (n == 0) {
+        *this = other;
+        return;
+    }
+    uint64_t total = n + other.n;
+    double delta = other.mu - mu;
+    mu += delta * other.n / total;
+    m2 += other.m2 + delta * delta * ((double) n * other.n / total);
+    n = total;
+    lo = std::min(lo, other.lo);
+    hi = std::max(hi, other.hi);
+
+    if (buckets.size() < other.buckets.size()) {
+        buckets.resize(other.buckets.size());
+    }
+    for (size_t i = 0; i < other.buckets.size(); i++) {
+        buckets[i] += other.buckets[i];
+    }
+}
+
+double Accumulator::stddev() const {
+    return std::sqrt(variance());
+}
+
+double Accumulator::ci() const {
+    // No spread to estimate from a single sample
+    if (n < 2) {
+        return NAN;
+    }
+    size_t df = n - 1;
+    double t = df <= 30 ? student_t[df - 1] : 1.960 + 2.5 / df;
+    return t * stddev() / std::sqrt((double) n);
+}
+
+double Accumulator::quantile(double q) const {
+    if (n == 0) {
+        return 0.0;
+    }
+    // Nearest rank
+    uint64_t rank = std::max(std::ceil(q * n), 1.0);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(std::max(bucket_value(i), lo), hi);
+        }
+    }
+    return hi;
+}
+
+void Accumulator::write(std::ostream &out) const {
+    uint64_t size = buckets.size();
+    out.write(reinterpret_cast<const char *>(&n), sizeof(n));
+    out.write(reinterpret_cast<const char *>(&mu), sizeof(mu));
+    out.write(reinterpret_cast<const char *>(&m2), sizeof(m2));
+    out.write(reinterpret_cast<const char *>(&lo), sizeof(lo));
+    out.write(reinterpret_cast<const char *>(&hi), sizeof(hi));
+    out.write(reinterpret_cast<const char *>(&size), sizeof(size));
+    out.write(reinterpret_cast<const char *>(buckets.data()),
+        size * sizeof(uint64_t));
+}
+
+void Accumulator::read(std::istream &in) {
+    uint64_t size = 0;
+    in.read(reinterpret_cast<char *>(&n), sizeof(n));
+    in.read(reinterpret_cast<char *>(&mu), sizeof(mu));
+    in.read(reinterpret_cast<char *>(&m2), sizeof(m2));
+    in.read(reinterpret_cast<char *>(&lo), sizeof(lo));
+    in.read(reinterpret_cast<char *>(&hi), sizeof(hi));
+    in.read(reinterpret_cast<char *>(&size), sizeof(size));
+    if (!in || size > (1 << 16)) {
+        in.setstate(std::ios::failbit);
+        return;
+    }
+    buckets.resize(size);
+    in.read(reinterpret_cast<char *>(buckets.data()),
+        size * sizeof(uint64_t));
+}
@@ -0,0 +1,100 @@
+/**
+ * @file accumulator.h
+ * Mergeable streaming accumulator interface.
+ */
+
+#ifndef __accumulator_h
+#define __accumulator_h
+
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+namespace Evacuation {
+
+/**
+ * Streaming accumulator of a non-negative sample.
+ * Moments are kept with Welford's update and merged with Chan's formula,
+ * percentiles come from a log-linear histogram (32 buckets per octave,
+ * i.e. relative error below 1.6 %, absolute resolution 1/32 below 2).
+ * Accumulators are not synchronised; each thread fills its own and the
+ * results are merged afterwards.
+ */
+class Accumulator {
+public:
+    Accumulator() :
+        n{0}, mu{0.0}, m2{0.0}, lo{0.0}, hi{0.0}
+    {}
+
+    /** Add a sample value. */
+    void push(double x);
+
+    /**
+     * Size the histogram for samples up to x and an octave beyond, so
+     * pushing them does not allocate (the histogram grows by doubling).
+     */
+    void reserve(double x);
+
+    /** Merge other accumulator into this one. */
+    void merge(const Accumulator &other);
+
+    /** @return number of samples */
+    uint64_t count() const { return n; }
+
+    /** @return sample mean */
+    double mean() const { return mu; }
+
+    /** @return unbiased sample variance */
+    double variance() const { return n > 1 ? m2 / (n - 1) : 0.0; }
+
+    /** @return sample standard deviation */
+    double stddev() const;
+
+    /** @return smallest sample */
+    double min() const { return lo; }
+
+    /** @return largest sample */
+    double max() const { return hi; }
+
+    /**
+     * @return half-width of the 95 % confidence interval of the mean, NaN
+     * (undefined) with fewer than two samples
+     */
+    double ci() const;
+
+    /**
+     * @param q quantile from [0, 1]
+     * @return estimated quantile of the sample
+     */
+    double quantile(double q) const;
+
+    /** Write binary representation. */
+    void write(std::ostream &out) const;
+
+    /** Read binary representation. */
+    void read(std::istream &in);
+
+private:
+    /// Number of samples
+    uint64_t n;
+    /// Mean
+    double mu;
+    /// Sum of squared differences from the mean
+    double m2;
+    /// Minimum
+    double lo;
+    /// Maximum
+    double hi;
+    /// Histogram (grown on demand, see reserve())
+    std::vector<uint64_t> buckets;
+
+    /** @return histogram bucket of a value */
+    static size_t bucket(double x);
+
+    /** @return representative value of a histogram bucket */
+    static double bucket_value(size_t index);
+};
+
+} // end of namespace
+
+#endif
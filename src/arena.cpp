@@ -0,0 +1,76 @@
+/**
+ * @file arena.cpp
+ * Per-step arena allocator implementation.
+ */
+
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+
+#include "arena.h"
+
+using namespace Evacuation;
+
+#ifdef ALLOCATION_PROFILE
+
+/// Heap allocations of the thread
+static thread_local uint64_t allocation_count = 0;
+
+// Replaces the allocator of the whole program (profiling builds only)
+void *operator new(size_t size) {
+    allocation_count++;
+    if (void *p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+uint64_t Evacuation::allocations() {
+    return allocation_count;
+}
+
+#else
+
+uint64_t Evacuation::allocations() {
+    return 0;
+}
+
+#endif
+
+Arena::Arena(size_t capacity) :
+    capacity{capacity}, used{0}, total{capacity}
+{
+    blocks.emplace_back(new char[capacity]);
+}
+
+void *Arena::allocate(size_t size, size_t align) {
+    size_t offset = (used + align - 1) & ~(align - 1);
+    if (offset + size > capacity) {
+        // Chain a block; reset() merges the blocks
+        capacity = std::max(2 * capacity, size + align);
+        total += capacity;
+        blocks.emplace_back(new char[capacity]);
+        offset = 0;
+    }
+    used = offset + size;
+    return blocks.back().get() + offset;
+}
+
+void Arena::reset() {
+    if (blocks.size() > 1) {
+        // Headroom for steps somewhat larger than this one
+        blocks.clear();
+        capacity = 2 * total;
+        total = capacity;
+        blocks.emplace_back(new char[capacity]);
+    }
+    used = 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file arena.h
+ * Per-step arena allocator interface.
+ */
+
+#ifndef __arena_h
+#define __arena_h
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+namespace Evacuation {
+
+/**
+ * Monotonic arena for the temporaries of a step.
+ *
+ * Allocations bump a pointer through the current block; deallocation
+ * is a no-op and everything is released at once by reset(). When a step
+ * outgrows the block, further blocks are chained. The next reset()
+ * replaces them by a single block twice the size of the whole step, so
+ * steady-state steps allocate nothing from the heap.
+ */
+class Arena {
+public:
+    /** @param capacity size of the first block in bytes */
+    explicit Arena(size_t capacity = 1 << 16);
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    /** @return storage for size bytes aligned to align */
+    void *allocate(size_t size, size_t align);
+
+    /** Release all allocations. */
+    void reset();
+
+private:
+    /// Blocks, the current one last
+    std::vector<std::unique_ptr<char[]>> blocks;
+    /// Size of the current block
+    size_t capacity;
+    /// Used bytes of the current block
+    size_t used;
+    /// Bytes in all blocks
+    size_t total;
+};
+
+/** STL allocator drawing from an Arena. */
+template<typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena &arena) : arena{&arena} {}
+
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena{other.arena} {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return arena == other.arena;
+    }
+
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+        return arena != other.arena;
+    }
+
+private:
+    template<typename U> friend class ArenaAllocator;
+
+    /// Arena providing the storage
+    Arena *arena;
+};
+
+/// Vector of temporaries of a step.
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/// Heap allocations are counted. Counting replaces the global operator
+/// new of the whole program, so only a build with ALLOCATION_PROFILE
+/// defined (make PROFILE=1) counts.
+#ifdef ALLOCATION_PROFILE
+constexpr bool counting_allocations = true;
+#else
+constexpr bool counting_allocations = false;
+#endif
+
+/**
+ * @return number of heap allocations (global operator new) made by the
+ * calling thread so far, 0 unless counting_allocations
+ */
+uint64_t allocations();
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,197 @@
+/**
+ * @file checkpoint.cpp
+ * CA checkpoint implementation.
+ */
+
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+
+#include "checkpoint.h"
+
+using namespace Evacuation;
+
+constexpr char Checkpoint::signature[8];
+constexpr uint32_t Checkpoint::version;
+
+/// Byte order mark as written by the producer.
+static constexpr uint32_t byte_order_mark = 0x01020304;
+
+/// Cell types carrying agent data.
+static constexpr int AgentCells = Person | PersonWithSmoke | PersonAtExit;
+
+void Checkpoint::store(const CA &ca, const std::string &filename) {
+    // The smoke plane keeps a random stream and a frontier of its own
+    if (ca.smoke_spread != InlineSmoke) {
+        throw std::logic_error("checkpoints need inline smoke spreading");
+    }
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, signature, sizeof(signature));
+    header.byte_order = byte_order_mark;
+    header.version = version;
+    header.height = ca.height;
+    header.width = ca.width;
+    header.exits = ca.exit_states.size();
+    std::memcpy(header.rng, ca.rng.state, sizeof(header.rng));
+    header.pedestrians = ca.stat.pedestrians;
+    header.time = ca.stat.time;
+    header.smoke_exposed = ca.stat.smoke_exposed;
+    header.moves = ca.stat.moves;
+    header.evac_time = ca.stat.evac_time;
+    header.max_smoke_exposed = ca.stat.max_smoke_exposed;
+    header.stalled = ca.stalled;
+    header.closest = ca.closest;
+    for (size_t i = 0; i < ModelParams::count; i++) {
+        header.params[i] = ca.params().at(i);
+    }
+
+    // Planes
+    std::vector<uint16_t> types;
+    std::vector<uint32_t> agents;
+    types.reserve((size_t) ca.height * ca.width);
+    for (unsigned row = 0; row < ca.height; row++) {
+        for (unsigned col = 0; col < ca.width; col++) {
+            const Cell &c = ca.cell(row, col);
+            types.push_back(c.type);
+            if (c.type & AgentCells) {
+                agents.push_back(row);
+                agents.push_back(col);
+                agents.push_back(c.smoke_exposed);
+            }
+        }
+    }
+    header.agents = agents.size() / 3;
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("could not open checkpoint file");
+    }
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (auto &es : ca.exit_states) {
+        uint32_t pos[2] = {(uint32_t) es.first, (uint32_t) es.second};
+        out.write(reinterpret_cast<const char *>(pos), sizeof(pos));
+    }
+    out.write(reinterpret_cast<const char *>(types.data()),
+        types.size() * sizeof(uint16_t));
+    out.write(reinterpret_cast<const char *>(agents.data()),
+        agents.size() * sizeof(uint32_t));
+    ca.stat.person_evac.write(out);
+    if (!out) {
+        throw std::runtime_error("could not write checkpoint file");
+    }
+}
+
+CA Checkpoint::load(const std::string &filename) {
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::invalid_argument("could not open checkpoint file");
+    }
+    uint64_t size = in.tellg();
+    in.seekg(0);
+
+    Header header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, signature, sizeof(signature)) != 0 ||
+        header.byte_order != byte_order_mark ||
+        header.version != version)
+    {
+        throw std::invalid_argument("invalid checkpoint file");
+    }
+
+    // The sections have to fit the file before the header is trusted
+    // with an allocation (written so that a crafted count cannot
+    // overflow)
+    uint64_t left = size - sizeof(header);
+    uint64_t cells = (uint64_t) header.height * header.width;
+    auto take = [&left](uint64_t count, uint64_t item) {
+        if (count > left / item) {
+            return false;
+        }
+        left -= count * item;
+        return true;
+    };
+    if (!take(cells, sizeof(uint16_t)) ||
+        !take(header.exits, 2 * sizeof(uint32_t)) ||
+        !take(header.agents, 3 * sizeof(uint32_t)))
+    {
+        throw std::invalid_argument("truncated checkpoint file");
+    }
+
+    CA ca(header.height, header.width);
+    std::memcpy(ca.rng.state, header.rng, sizeof(header.rng));
+    ca.stat.pedestrians = header.pedestrians;
+    ca.stat.time = header.time;
+    ca.stat.smoke_exposed = header.smoke_exposed;
+    ca.stat.moves = header.moves;
+    ca.stat.evac_time = header.evac_time;
+    ca.stat.max_smoke_exposed = header.max_smoke_exposed;
+    ca.stalled = header.stalled;
+    ca.closest = header.closest;
+    ModelParams params;
+    for (size_t i = 0; i < ModelParams::count; i++) {
+        params.at(i) = header.params[i];
+    }
+    ca.set_params(params);
+
+    // Exit states
+    for (uint64_t i = 0; i < header.exits; i++) {
+        uint32_t pos[2];
+        if (!in.read(reinterpret_cast<char *>(pos), sizeof(pos))) {
+            throw std::invalid_argument("truncated checkpoint file");
+        }
+        if (pos[0] >= ca.height || pos[1] >= ca.width) {
+            throw std::invalid_argument("invalid exit in checkpoint file");
+        }
+        ca.exit_states.push_back(CellPosition(pos[0], pos[1]));
+    }
+
+    // Type plane
+    std::vector<uint16_t> types(ca.width);
+    for (unsigned row = 0; row < ca.height; row++) {
+        if (!in.read(reinterpret_cast<char *>(types.data()),
+            types.size() * sizeof(uint16_t)))
+        {
+            throw std::invalid_argument("truncated checkpoint file");
+        }
+        for (unsigned col = 0; col < ca.width; col++) {
+            if (!valid_cell_type(types[col])) {
+                throw std::invalid_argument(
+                    "invalid cell type in checkpoint file");
+            }
+            ca.cell(row, col).type = (CellType) types[col];
+        }
+    }
+    for (auto &es : ca.exit_states) {
+        if (!(ca.cell(es).type & (Exit | PersonAtExit))) {
+            throw std::invalid_argument("invalid exit in checkpoint file");
+        }
+    }
+
+    // Agent table
+    for (uint64_t i = 0; i < header.agents; i++) {
+        uint32_t agent[3];
+        if (!in.read(reinterpret_cast<char *>(agent), sizeof(agent))) {
+            throw std::invalid_argument("truncated checkpoint file");
+        }
+        if (agent[0] >= ca.height || agent[1] >= ca.width ||
+            !(ca.cell(agent[0], agent[1]).type & AgentCells))
+        {
+            throw std::invalid_argument("invalid agent in checkpoint file");
+        }
+        ca.cell(agent[0], agent[1]).smoke_exposed = agent[2];
+    }
+    ca.stat.person_evac.read(in);
+
+    if (!in) {
+        throw std::invalid_argument("truncated checkpoint file");
+    }
+
+    // Exit distances are only needed for display until the next step
+    ca.group_exits();
+    ca.label_regions();
+    ca.recount();
+    ca.recompute_shortest_paths();
+    return ca;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file checkpoint.h
+ * CA checkpoint interface.
+ */
+
+#ifndef __checkpoint_h
+#define __checkpoint_h
+
+#include <string>
+#include <cstdint>
+
+#include "evacuation.h"
+
+namespace Evacuation {
+
+/**
+ * Binary snapshot of a running CA.
+ *
+ * File layout (native byte order):
+ *   header | exit list (row, col pairs of uint32)
+ *          | type plane (uint16 per cell, row-major)
+ *          | agent table (row, col, smoke exposure as uint32 per agent)
+ *          | per-person evacuation time accumulator
+ *
+ * Exit distances are not stored; evolve() recomputes them before they
+ * are read, so a restored CA continues bit-identically. Smoke spreading
+ * apart from the people (see SmokePlane) keeps state that is not
+ * stored, so only CAs spreading smoke inline are checkpointed.
+ */
+class Checkpoint {
+public:
+    /** On-disk header. */
+    struct Header {
+        /** File signature, see Checkpoint::signature. */
+        char magic[8];
+        /** Byte order mark. */
+        uint32_t byte_order;
+        /** Format version. */
+        uint32_t version;
+        /** Number of rows. */
+        uint32_t height;
+        /** Number of columns. */
+        uint32_t width;
+        /** Number of exit cells. */
+        uint64_t exits;
+        /** Number of agents. */
+        uint64_t agents;
+        /** Generator state. */
+        uint64_t rng[4];
+        /** Statistics::pedestrians */
+        int64_t pedestrians;
+        /** Statistics::time, i.e. the step counter */
+        double time;
+        /** Statistics::smoke_exposed */
+        double smoke_exposed;
+        /** Statistics::moves */
+        double moves;
+        /** Statistics::evac_time */
+        double evac_time;
+        /** Statistics::max_smoke_exposed */
+        double max_smoke_exposed;
+        /** Watchdog: steps without progress, see CA::stall() */
+        uint64_t stalled;
+        /** Watchdog: lowest total exit distance of the people */
+        double closest;
+        /** Model parameters (in order of ModelParams::names). */
+        float params[ModelParams::count];
+    };
+
+    /** File signature. */
+    static constexpr char signature[8] = {'E','V','A','C','C','K','P','\0'};
+    /** Current format version. */
+    static constexpr uint32_t version = 5;
+
+    /**
+     * Store a snapshot of the CA.
+     * @param ca model to store
+     * @param filename name of output file
+     * @throw runtime_error if failed to write output file
+     * @throw logic_error if the CA does not spread smoke inline
+     */
+    static void store(const CA &ca, const std::string &filename);
+
+    /**
+     * Restore a CA from a snapshot.
+     * @param filename name of input file
+     * @return instance of CA class
+     * @throw invalid_argument if failed to process input file or it is
+     * malformed (sections that do not fit the file, see also
+     * valid_cell_type())
+     */
+    static CA load(const std::string &filename);
+};
+
+} // end of namespace
+
+#endif
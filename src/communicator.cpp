@@ -0,0 +1,141 @@
+/**
+ * @file communicator.cpp
+ * Shared memory communicator implementation.
+ */
+
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "communicator.h"
+
+using namespace Evacuation;
+
+/** @return size rounded up to 64 bytes (a cache line) */
+static inline size_t align(size_t size) {
+    return (size + 63) & ~(size_t) 63;
+}
+
+/*
+ * Layout of the mapping:
+ *   barrier | reduction slot per worker
+ *           | mailbox per (sender, receiver) | result slot per worker
+ * Mailboxes and result slots start with the uint64 length of the data.
+ */
+
+ShmCommunicator::ShmCommunicator(
+    unsigned size, size_t capacity, size_t result_capacity) :
+    memory{MAP_FAILED}, workers{size}, own{0},
+    capacity{align(capacity + sizeof(uint64_t))},
+    result_capacity{align(result_capacity + sizeof(uint64_t))}
+{
+    length = align(sizeof(pthread_barrier_t)) + size * align(sizeof(double))
+        + (size_t) size * size * this->capacity
+        + size * this->result_capacity;
+    memory = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("could not map shared memory");
+    }
+
+    pthread_barrierattr_t attr;
+    pthread_barrierattr_init(&attr);
+    pthread_barrierattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    int err = pthread_barrier_init(
+        static_cast<pthread_barrier_t *>(memory), &attr, size);
+    pthread_barrierattr_destroy(&attr);
+    if (err != 0) {
+        munmap(memory, length);
+        throw std::runtime_error("could not create shared barrier");
+    }
+}
+
+ShmCommunicator::~ShmCommunicator() {
+    // Workers leave through _exit(), so this runs in the launcher only
+    pthread_barrier_destroy(static_cast<pthread_barrier_t *>(memory));
+    munmap(memory, length);
+}
+
+void ShmCommunicator::attach(unsigned rank) {
+    own = rank;
+}
+
+double *ShmCommunicator::reduction(unsigned rank) const {
+    char *base = static_cast<char *>(memory)
+        + align(sizeof(pthread_barrier_t));
+    return reinterpret_cast<double *>(base + rank * align(sizeof(double)));
+}
+
+char *ShmCommunicator::mailbox(unsigned from, unsigned to) const {
+    char *base = reinterpret_cast<char *>(reduction(workers));
+    return base + ((size_t) from * workers + to) * capacity;
+}
+
+char *ShmCommunicator::result_slot(unsigned rank) const {
+    return mailbox(workers, 0) + rank * result_capacity;
+}
+
+void ShmCommunicator::barrier() {
+    pthread_barrier_wait(static_cast<pthread_barrier_t *>(memory));
+}
+
+std::vector<Buffer> ShmCommunicator::exchange(const std::vector<Buffer> &out)
+{
+    for (unsigned to = 0; to < workers; to++) {
+        uint64_t size = to < out.size() ? out[to].size() : 0;
+        if (size + sizeof(uint64_t) > capacity) {
+            throw std::runtime_error("message exceeds mailbox capacity");
+        }
+        char *box = mailbox(own, to);
+        std::memcpy(box, &size, sizeof(size));
+        if (size > 0) {
+            std::memcpy(box + sizeof(size), out[to].data(), size);
+        }
+    }
+    barrier();
+
+    std::vector<Buffer> in(workers);
+    for (unsigned from = 0; from < workers; from++) {
+        const char *box = mailbox(from, own);
+        uint64_t size;
+        std::memcpy(&size, box, sizeof(size));
+        in[from].assign(box + sizeof(size), box + sizeof(size) + size);
+    }
+
+    // Mailboxes are reused by the next exchange
+    barrier();
+    return in;
+}
+
+double ShmCommunicator::allreduce(double value, Op op) {
+    *reduction(own) = value;
+    barrier();
+    double res = *reduction(0);
+    for (unsigned r = 1; r < workers; r++) {
+        double v = *reduction(r);
+        res = op == Sum ? res + v : std::max(res, v);
+    }
+    barrier();
+    return res;
+}
+
+void ShmCommunicator::put_result(const Buffer &result) {
+    uint64_t size = result.size();
+    if (size + sizeof(uint64_t) > result_capacity) {
+        throw std::runtime_error("result exceeds slot capacity");
+    }
+    char *slot = result_slot(own);
+    std::memcpy(slot, &size, sizeof(size));
+    std::memcpy(slot + sizeof(size), result.data(), size);
+}
+
+Buffer ShmCommunicator::result(unsigned rank) const {
+    const char *slot = result_slot(rank);
+    uint64_t size;
+    std::memcpy(&size, slot, sizeof(size));
+    return Buffer(slot + sizeof(size), slot + sizeof(size) + size);
+}
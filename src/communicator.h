@@ -0,0 +1,116 @@
+/**
+ * @file communicator.h
+ * Message passing interface between domain workers.
+ */
+
+#ifndef __communicator_h
+#define __communicator_h
+
+#include <vector>
+#include <cstddef>
+
+namespace Evacuation {
+
+/// Message payload.
+using Buffer = std::vector<char>;
+
+/**
+ * Collective communication between the workers of a decomposed model.
+ * The operations mirror MPI collectives (MPI_Barrier, MPI_Alltoallv and
+ * MPI_Allreduce), so an MPI implementation can be dropped in; every
+ * worker has to enter every collective in the same order.
+ */
+class Communicator {
+public:
+    /** Reduction operations. */
+    enum Op { Sum, Max };
+
+    virtual ~Communicator() = default;
+
+    /** @return index of the calling worker */
+    virtual unsigned rank() const = 0;
+
+    /** @return number of workers */
+    virtual unsigned size() const = 0;
+
+    /** Wait until all workers reach the barrier. */
+    virtual void barrier() = 0;
+
+    /**
+     * Personalised all-to-all exchange.
+     * @param out message to each worker (empty = none)
+     * @return message from each worker
+     * @throw runtime_error if a message does not fit the transport
+     */
+    virtual std::vector<Buffer> exchange(const std::vector<Buffer> &out) = 0;
+
+    /** @return value reduced over all workers */
+    virtual double allreduce(double value, Op op) = 0;
+};
+
+/**
+ * Communicator of worker processes forked from one launcher.
+ * Messages pass through mailboxes in an anonymous shared mapping,
+ * synchronised by a process-shared barrier. The communicator is created
+ * by the launcher before forking; each worker then attaches its rank.
+ */
+class ShmCommunicator : public Communicator {
+public:
+    /**
+     * Map the shared memory.
+     * @param size number of workers
+     * @param capacity maximum size of a message in bytes
+     * @param result_capacity maximum size of a result in bytes
+     * @throw runtime_error if the memory could not be mapped
+     */
+    ShmCommunicator(unsigned size, size_t capacity, size_t result_capacity);
+    ~ShmCommunicator();
+
+    ShmCommunicator(const ShmCommunicator &) = delete;
+    ShmCommunicator &operator=(const ShmCommunicator &) = delete;
+
+    /** Act as the worker of the specified rank (in a forked worker). */
+    void attach(unsigned rank);
+
+    unsigned rank() const override { return own; }
+    unsigned size() const override { return workers; }
+    void barrier() override;
+    std::vector<Buffer> exchange(const std::vector<Buffer> &out) override;
+    double allreduce(double value, Op op) override;
+
+    /**
+     * Publish the result of the calling worker.
+     * @throw runtime_error if the result does not fit
+     */
+    void put_result(const Buffer &result);
+
+    /** @return result published by a worker (after it exited) */
+    Buffer result(unsigned rank) const;
+
+private:
+    /// Shared mapping
+    void *memory;
+    /// Size of the mapping
+    size_t length;
+    /// Number of workers
+    unsigned workers;
+    /// Rank of the calling worker
+    unsigned own;
+    /// Capacity of a mailbox
+    size_t capacity;
+    /// Capacity of a result slot
+    size_t result_capacity;
+
+    /** @return reduction slot of a worker */
+    double *reduction(unsigned rank) const;
+
+    /** @return mailbox from one worker to another */
+    char *mailbox(unsigned from, unsigned to) const;
+
+    /** @return result slot of a worker */
+    char *result_slot(unsigned rank) const;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,230 @@
+/**
+ * @file compact.cpp
+ * Compacted walkable-cell graph implementation.
+ */
+
+#include <algorithm>
+#include <climits>
+
+#include "compact.h"
+
+using namespace Evacuation;
+
+CellGraph::CellGraph(const CA &ca) : epoch{0} {
+    auto l = std::make_shared<Layout>();
+    size_t size = (size_t) ca.height * ca.width;
+    l->index.assign(size, UINT32_MAX);
+    // Cell types only change within WalkableCells (people, smoke), but
+    // for blocked exits, which rebuild the graph; regions no exit can be
+    // reached from are left out
+    auto walkable = [&ca](int row, int col) {
+        return ca.cell_check(row, col) &&
+            (ca.cell(row, col).type & WalkableCells) &&
+            (ca.reachable.empty() || ca.reachable[ca.cell_index(row, col)]);
+    };
+    auto number = [&](unsigned row, unsigned col) {
+        l->index[(size_t) row * ca.width + col] = l->nodes.size();
+        l->nodes.push_back(Node{row, col});
+    };
+
+    // Breadth-first from the exits, then the cells they do not reach
+    for (auto &es : ca.exit_states) {
+        if (l->index[es.first * ca.width + es.second] == UINT32_MAX) {
+            number(es.first, es.second);
+        }
+    }
+    for (size_t head = 0; head < l->nodes.size(); head++) {
+        Node n = l->nodes[head];
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                int r = n.row + dr, c = n.col + dc;
+                if (walkable(r, c) &&
+                    l->index[(size_t) r * ca.width + c] == UINT32_MAX)
+                {
+                    number(r, c);
+                }
+            }
+        }
+    }
+    for (unsigned row = 0; row < ca.height; row++) {
+        for (unsigned col = 0; col < ca.width; col++) {
+            if (walkable(row, col) &&
+                l->index[(size_t) row * ca.width + col] == UINT32_MAX)
+            {
+                number(row, col);
+            }
+        }
+    }
+
+    // Neighbours in the order the CA solver visits them
+    static const int lane_of[3][3] = {{4, 0, 5}, {1, -1, 2}, {6, 3, 7}};
+    l->offsets.reserve(l->nodes.size() + 1);
+    for (auto &n : l->nodes) {
+        l->offsets.push_back(l->neighbours.size());
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                int r = n.row + dr, c = n.col + dc;
+                if ((dr != 0 || dc != 0) && walkable(r, c)) {
+                    l->neighbours.push_back(
+                        l->index[(size_t) r * ca.width + c]);
+                    l->lanes.push_back(lane_of[1 - dr][1 - dc]);
+                }
+            }
+        }
+    }
+    l->offsets.push_back(l->neighbours.size());
+    layout = l;
+}
+
+template<typename Distance, bool SmokePresent>
+void CellGraph::solve(CA &ca, const People *targets) {
+    const Layout &l = *layout;
+    size_t n = l.nodes.size();
+    if (state.size() != n) {
+        state.assign(n, 0);
+        needed.assign(n, 0);
+        distance.resize(n);
+        heap.reserve(n);
+        epoch = 0;
+    }
+    if (ca.best_moves.size() != ca.cells.size()) {
+        ca.best_moves.resize(ca.cells.size());
+    }
+
+    // Stamps of earlier solves read as unreached
+    if (epoch >= UINT32_MAX / 2 - 1) {
+        std::fill(state.begin(), state.end(), 0);
+        std::fill(needed.begin(), needed.end(), 0);
+        epoch = 0;
+    }
+    epoch++;
+    const uint32_t reached = 2 * epoch, settled = 2 * epoch + 1;
+
+    // Accrual of each cell type
+    Distance accruals[CellTypes];
+    for (unsigned b = 0; b < CellTypes; b++) {
+        CellType type = (CellType) (1 << b);
+        Distance accrual = 1;
+        if (type & (Person | PersonWithSmoke)) {
+            accrual *= ca.parameters.occupied_distance;
+        }
+        if (SmokePresent && (type & (Smoke | PersonWithSmoke))) {
+            accrual *= ca.parameters.smoke_distance;
+        }
+        accruals[b] = accrual;
+    }
+
+    // Cells whose distances the targets read
+    size_t remaining = 0;
+    if (targets != nullptr) {
+        for (auto &t : *targets) {
+            for (int dr = -1; dr <= 1; dr++) {
+                for (int dc = -1; dc <= 1; dc++) {
+                    int r = t.first + dr, c = t.second + dc;
+                    if (!ca.cell_check(r, c) ||
+                        !(ca.cell(r, c).type & WalkableCells))
+                    {
+                        continue;
+                    }
+                    uint32_t i = l.index[(size_t) r * ca.width + c];
+                    if (needed[i] != epoch) {
+                        needed[i] = epoch;
+                        remaining++;
+                    }
+                }
+            }
+            ca.best_moves[ca.cell_index(t)] = UINT32_MAX;
+        }
+    }
+    else {
+        std::fill(ca.best_moves.begin(), ca.best_moves.end(), UINT32_MAX);
+    }
+
+    auto later = [](const HeapEntry &a, const HeapEntry &b) {
+        return a.first > b.first;
+    };
+    heap.clear();
+    for (auto &es : ca.exit_states) {
+        uint32_t i = l.index[es.first * ca.width + es.second];
+        distance[i] = 0;
+        state[i] = reached;
+        heap.push_back(HeapEntry(0, i));
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    bool complete = false;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        uint32_t i = heap.back().second;
+        heap.pop_back();
+        if (state[i] == settled) {
+            continue;
+        }
+        state[i] = settled;
+        complete = targets != nullptr && needed[i] == epoch &&
+            --remaining == 0;
+
+        // Successors pay the accrual of the cell they step from
+        Node here = l.nodes[i];
+        Cell &current = ca.cell(here.row, here.col);
+        Distance d = distance[i];
+        unsigned exit_distance = (unsigned) d;
+        current.exit_distance = exit_distance;
+        Distance next_distance = d + accruals[__builtin_ctz(current.type)];
+        for (uint32_t e = l.offsets[i]; e < l.offsets[i + 1]; e++) {
+            uint32_t j = l.neighbours[e];
+            Node there = l.nodes[j];
+            CellType type = ca.cell(there.row, there.col).type;
+
+            // Cells settle by distance, so the first settled neighbours
+            // of a person are its best moves
+            if ((type & (Person | PersonWithSmoke)) &&
+                exit_distance <= UINT32_MAX >> 8)
+            {
+                uint32_t &best =
+                    ca.best_moves[ca.cell_index(there.row, there.col)];
+                uint32_t key = exit_distance << 8;
+                if (key < (best & ~0xffu)) {
+                    best = key;
+                }
+                if (key == (best & ~0xffu)) {
+                    best |= 1 << l.lanes[e];
+                }
+            }
+
+            if (complete || !(type & WalkableCells) ||
+                state[j] == settled ||
+                (state[j] == reached && next_distance >= distance[j]))
+            {
+                continue;
+            }
+            distance[j] = next_distance;
+            state[j] = reached;
+            heap.push_back(HeapEntry(next_distance, j));
+            std::push_heap(heap.begin(), heap.end(), later);
+        }
+        if (complete) {
+            break;
+        }
+    }
+    ca.moves_current = targets == nullptr || complete;
+
+    // A whole field leaves no stale distances behind
+    if (targets == nullptr) {
+        for (size_t c = 0; c < l.index.size(); c++) {
+            uint32_t i = l.index[c];
+            if (i == UINT32_MAX || state[i] != settled) {
+                ca.cell(c / ca.width, c % ca.width).exit_distance = UINT_MAX;
+            }
+        }
+    }
+}
+
+template void CellGraph::solve<unsigned, false>(
+    CA &, const People *);
+template void CellGraph::solve<unsigned, true>(
+    CA &, const People *);
+template void CellGraph::solve<double, false>(
+    CA &, const People *);
+template void CellGraph::solve<double, true>(
+    CA &, const People *);
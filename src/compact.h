@@ -0,0 +1,98 @@
+/**
+ * @file compact.h
+ * Compacted walkable-cell graph interface.
+ */
+
+#ifndef __compact_h
+#define __compact_h
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include "evacuation.h"
+
+namespace Evacuation {
+
+/**
+ * Exact exit distance solver over the walkable cells only.
+ *
+ * At build time, the cells that are or may become walkable (all but
+ * walls, obstacles and obstacles with smoke) are numbered densely in
+ * breadth-first order from the exits. Regions no exit can be reached
+ * from (see CA::label_regions()) are left out; in models whose regions
+ * are not labelled, their cells follow. The Moore neighbourhoods of the
+ * numbered cells are stored as a compressed sparse row adjacency. Floor
+ * plans typically leave much of the bounding box outside the building or
+ * inside walls. Those cells take no space in the solver workspace, and
+ * the search front moves through contiguous memory.
+ *
+ * The solve is the Dijkstra solve of the CA, with the same early exit,
+ * the same distances for the cells people read, and the same best-move
+ * masks. Distances of cells reached but not settled are not written back
+ * (they are left stale, like those of cells beyond the search front).
+ * The layout is shared by copies of the graph and rebuilt when an exit
+ * is blocked.
+ */
+class CellGraph {
+public:
+    /** Number the walkable cells of a CA and link their neighbours. */
+    explicit CellGraph(const CA &ca);
+
+    /**
+     * Recompute exit distances.
+     * @tparam Distance unsigned for integral accruals, double otherwise
+     * @tparam SmokePresent smoke cells exist (smoke accruals apply)
+     * @param ca automaton to solve (the one the graph was built for)
+     * @param targets people whose moves read the distances
+     * (nullptr = whole field)
+     */
+    template<typename Distance, bool SmokePresent>
+    void solve(CA &ca, const People *targets);
+
+    /** @return number of walkable cells */
+    size_t size() const {
+        return layout->nodes.size();
+    }
+
+private:
+    /** Walkable cell. */
+    struct Node {
+        unsigned row, col;
+    };
+
+    /** Static adjacency shared by copies of the graph. */
+    struct Layout {
+        /// Cells by dense index
+        std::vector<Node> nodes;
+        /// Dense index of each cell in row-major order (UINT32_MAX = none)
+        std::vector<uint32_t> index;
+        /// Edges of node i are [offsets[i], offsets[i + 1])
+        std::vector<uint32_t> offsets;
+        /// Neighbour at the end of each edge
+        std::vector<uint32_t> neighbours;
+        /// Lane (see CA::next_move()) of the cell as seen from the
+        /// neighbour at the end of each edge
+        std::vector<uint8_t> lanes;
+    };
+
+    /// Heap entry (distance, dense index)
+    using HeapEntry = std::pair<double, uint32_t>;
+
+    /// Adjacency
+    std::shared_ptr<const Layout> layout;
+    /// Solve counter; stamps older than the current solve read as unset
+    uint32_t epoch;
+    /// Stamps: 2 * epoch once reached, 2 * epoch + 1 once settled
+    Plane<uint32_t> state;
+    /// Stamps: epoch if the targets read the cell
+    Plane<uint32_t> needed;
+    /// Tentative distances
+    Plane<double> distance;
+    /// Binary min-heap of reached cells (room for a cell each)
+    std::vector<HeapEntry> heap;
+};
+
+} // end of namespace
+
+#endif
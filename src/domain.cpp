@@ -0,0 +1,519 @@
+/**
+ * @file domain.cpp
+ * Domain decomposition implementation.
+ */
+
+#include <queue>
+#include <limits>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <functional>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "domain.h"
+
+using namespace Evacuation;
+
+/// Unreachable distance.
+static constexpr double infinity = std::numeric_limits<double>::infinity();
+
+/** Request to move a person into a halo cell. */
+struct Migration {
+    /// Column of the cell
+    uint32_t col;
+    /// Smoke exposure of the person
+    int32_t smoke_exposed;
+};
+
+/** Append raw values to a message. */
+template<typename T>
+static void append(Buffer &buffer, const T *values, size_t count) {
+    const char *bytes = reinterpret_cast<const char *>(values);
+    buffer.insert(buffer.end(), bytes, bytes + count * sizeof(T));
+}
+
+/** @return raw values of a message */
+template<typename T>
+static std::vector<T> values(const Buffer &buffer) {
+    std::vector<T> res(buffer.size() / sizeof(T));
+    std::memcpy(res.data(), buffer.data(), res.size() * sizeof(T));
+    return res;
+}
+
+Domain::Domain(const CA &model, Communicator &comm) :
+    comm(comm),
+    first{(unsigned) ((uint64_t) model.height * comm.rank() / comm.size())},
+    rows{(unsigned) ((uint64_t) model.height * (comm.rank() + 1) / comm.size())
+        - first},
+    top{comm.rank() > 0},
+    bottom{comm.rank() + 1 < comm.size()},
+    ca(rows + top + bottom, model.width)
+{
+    if (rows == 0) {
+        throw std::invalid_argument("more domains than rows");
+    }
+
+    // Owned rows and halos, with the regions labelled on the whole model
+    ca.reachable.assign(ca.cells.size(), 0);
+    for (unsigned row = 0; row < ca.height; row++) {
+        for (unsigned col = 0; col < ca.width; col++) {
+            ca.cell(row, col) = model.cell(first - top + row, col);
+            ca.reachable[ca.cell_index(row, col)] =
+                model.reachable[model.cell_index(first - top + row, col)];
+        }
+    }
+    for (auto &es : model.exit_states) {
+        if (es.first >= first && es.first < first + rows) {
+            exits.push_back(CellPosition(es.first - first + top, es.second));
+        }
+    }
+    ca.exit_states = exits;
+
+    // Independent stream of each band
+    Random rng = model.rng;
+    uint64_t seed = 0;
+    for (unsigned r = 0; r <= comm.rank(); r++) {
+        seed = rng();
+    }
+    ca.seed(seed);
+
+    // Counters of the whole model are kept by the first band
+    ca.stat = Statistics();
+    ca.stat.pedestrians = model.stat.pedestrians;
+    ca.stat.time = model.stat.time;
+    if (comm.rank() == 0) {
+        ca.stat = model.stat;
+    }
+    ca.set_params(model.params());
+    ca.recount();
+}
+
+unsigned Domain::neighbour(unsigned row) const {
+    return row < top ? comm.rank() - 1 : comm.rank() + 1;
+}
+
+void Domain::exchange_types() {
+    std::vector<Buffer> out(comm.size());
+    std::vector<uint16_t> types(ca.width);
+    auto border = [&](unsigned row, unsigned to) {
+        for (unsigned col = 0; col < ca.width; col++) {
+            types[col] = ca.cell(row, col).type;
+        }
+        append(out[to], types.data(), types.size());
+    };
+    if (top) {
+        border(top, comm.rank() - 1);
+    }
+    if (bottom) {
+        border(top + rows - 1, comm.rank() + 1);
+    }
+
+    std::vector<Buffer> in = comm.exchange(out);
+    auto halo_row = [&](unsigned row, unsigned from) {
+        auto types = values<uint16_t>(in[from]);
+        for (unsigned col = 0; col < ca.width && col < types.size(); col++) {
+            ca.cell(row, col).type = (CellType) types[col];
+        }
+    };
+    if (top) {
+        halo_row(0, comm.rank() - 1);
+    }
+    if (bottom) {
+        halo_row(top + rows, comm.rank() + 1);
+    }
+}
+
+bool Domain::evolve() {
+    ca.stat.time += 1;
+    exchange_types();
+
+    // Scan the owned cells (see CA::evolve_step())
+    const ModelParams &parameters = ca.params();
+    double evac_time = ca.stat.evac_time;
+    std::vector<CellPosition> people;
+    std::vector<CellPosition> smoke_cells;
+    int stranded = 0;
+    auto collect = [&](unsigned row, unsigned col) {
+        if (ca.reachable[ca.cell_index(row, col)]) {
+            people.push_back(CellPosition(row, col));
+        }
+        else {
+            stranded++;
+        }
+    };
+    for (unsigned row = top; row < top + rows; row++) {
+        for (unsigned col = 0; col < ca.width; col++) {
+            Cell &current = ca.cell(row, col);
+            switch (current.type) {
+                case PersonAppearance:
+                case Obstacle:
+                case Empty:
+                case Person:
+                {
+                    float smoke_neigh =
+                        ca.cell_neighbourhood(row, col, SmokeCells).size();
+                    if (smoke_neigh > 0) {
+                        float neigh = ca.cell_neighbourhood(
+                            row, col, ~(Exit | Wall)).size();
+                        if (smoke_neigh / neigh *
+                            parameters.smoke_spreading_rate >
+                            ca.rng.uniform())
+                        {
+                            smoke_cells.push_back(CellPosition(row, col));
+                        }
+                    }
+                    if (current.type == Person) {
+                        collect(row, col);
+                    }
+                    break;
+                }
+                case PersonAtExit:
+                    ca.evacuate(current, ca.tile(row, col));
+                    current.type = Exit;
+                    break;
+                case PersonWithSmoke:
+                    ca.stat.smoke_exposed += 1;
+                    current.smoke_exposed += 1;
+                    collect(row, col);
+                    break;
+                default:
+                    ;
+            }
+        }
+    }
+
+    // The run ends once only stranded people are left in every band
+    ca.stat.stranded = stranded;
+    bool res = comm.allreduce(people.size(), Communicator::Sum) > 0;
+
+    solve();
+    double remaining = 0;
+    for (auto &p : people) {
+        remaining += ca.cell(p).exit_distance;
+    }
+
+    // Propagate smoke
+    for (auto &c : smoke_cells) {
+        Cell &current = ca.cell(c);
+        ca.tile(c).smoke++;
+        if (current.type == Obstacle) {
+            current.type = ObstacleWithSmoke;
+        }
+        else if (current.type == Person) {
+            current.type = PersonWithSmoke;
+            current.smoke_exposed++;
+            ca.stat.smoke_exposed += 1;
+        }
+        else {
+            current.type = Smoke;
+        }
+    }
+    ca.smoke_count += smoke_cells.size();
+
+    move(people);
+    if (!res) {
+        return false;
+    }
+
+    // Watchdog over all bands (see CA::stall())
+    remaining = comm.allreduce(remaining, Communicator::Sum);
+    bool evacuated = comm.allreduce(
+        ca.stat.evac_time != evac_time, Communicator::Max) > 0;
+    bool lengthened = comm.allreduce(
+        !smoke_cells.empty(), Communicator::Max) > 0;
+    if (ca.stall(remaining, evacuated, lengthened)) {
+        ca.stat.stranded = 0;
+        for (unsigned row = top; row < top + rows; row++) {
+            for (unsigned col = 0; col < ca.width; col++) {
+                ca.stat.stranded += (ca.cell(row, col).type &
+                    (Person | PersonWithSmoke | PersonAtExit)) != 0;
+            }
+        }
+        return false;
+    }
+    return true;
+}
+
+void Domain::solve() {
+    unsigned width = ca.width;
+    std::vector<double> dist((size_t) ca.height * width, infinity);
+
+    using Entry = std::pair<double, size_t>;
+    while (true) {
+        // Local Dijkstra seeded by exits and halo distances
+        std::fill(dist.begin() + (size_t) top * width,
+            dist.begin() + (size_t) (top + rows) * width, infinity);
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>
+            heap;
+        for (auto &es : exits) {
+            dist[es.first * width + es.second] = 0;
+            heap.push(Entry(0, es.first * width + es.second));
+        }
+        for (unsigned row = 0; row < ca.height; row++) {
+            if (!halo(row)) {
+                continue;
+            }
+            for (unsigned col = 0; col < width; col++) {
+                size_t i = (size_t) row * width + col;
+                if (dist[i] < infinity) {
+                    heap.push(Entry(dist[i], i));
+                }
+            }
+        }
+        while (!heap.empty()) {
+            Entry e = heap.top();
+            heap.pop();
+            if (e.first > dist[e.second]) {
+                continue;
+            }
+            unsigned row = e.second / width, col = e.second % width;
+            double next = e.first + ca.accrual(ca.cell(row, col).type);
+            for (auto &s : ca.cell_neighbourhood(row, col, WalkableCells)) {
+                size_t j = s.first * width + s.second;
+                if (!halo(s.first) && next < dist[j]) {
+                    dist[j] = next;
+                    heap.push(Entry(next, j));
+                }
+            }
+        }
+
+        // Swap border distances
+        std::vector<Buffer> out(comm.size());
+        if (top) {
+            append(out[comm.rank() - 1], &dist[(size_t) top * width], width);
+        }
+        if (bottom) {
+            append(out[comm.rank() + 1],
+                &dist[(size_t) (top + rows - 1) * width], width);
+        }
+        std::vector<Buffer> in = comm.exchange(out);
+        bool changed = false;
+        auto halo_row = [&](unsigned row, unsigned from) {
+            auto border = values<double>(in[from]);
+            for (unsigned col = 0; col < width && col < border.size(); col++) {
+                double &d = dist[(size_t) row * width + col];
+                changed |= d != border[col];
+                d = border[col];
+            }
+        };
+        if (top) {
+            halo_row(0, comm.rank() - 1);
+        }
+        if (bottom) {
+            halo_row(top + rows, comm.rank() + 1);
+        }
+        if (comm.allreduce(changed, Communicator::Max) == 0) {
+            break;
+        }
+    }
+
+    for (unsigned row = 0; row < ca.height; row++) {
+        for (unsigned col = 0; col < width; col++) {
+            double d = dist[(size_t) row * width + col];
+            ca.cell(row, col).exit_distance =
+                d < (double) UINT_MAX ? (unsigned) d : UINT_MAX;
+        }
+    }
+}
+
+void Domain::move(std::vector<CellPosition> &people) {
+    const ModelParams &parameters = ca.params();
+    bool chaos = parameters.chaos_rate > 0;
+
+    // Moves within the band; moves into halos are requests
+    std::vector<Buffer> out(comm.size());
+    std::vector<std::vector<CellPosition>> pending(comm.size());
+    ca.rng.shuffle(people);
+    for (auto person : people) {
+        CellPosition next;
+        if (!ca.next_move(person, next, ca.rng)) {
+            continue;
+        }
+        int diff = ca.distance(person) - ca.distance(next);
+        if (!(diff >= 1 ||
+            (chaos && diff == 0 && parameters.chaos_rate > ca.rng.uniform())))
+        {
+            continue;
+        }
+        if (!halo(next.first)) {
+            ca.move(person, next);
+            continue;
+        }
+        unsigned to = neighbour(next.first);
+        Migration m{(uint32_t) next.second, ca.cell(person).smoke_exposed};
+        append(out[to], &m, 1);
+        pending[to].push_back(person);
+        // Nobody else in the band claims the cell
+        ca.cell(next).type = Person;
+    }
+
+    // Accept requests for cells still free, in random order
+    std::vector<Buffer> in = comm.exchange(out);
+    std::vector<Buffer> replies(comm.size());
+    for (unsigned from = 0; from < comm.size(); from++) {
+        auto requests = values<Migration>(in[from]);
+        if (requests.empty()) {
+            continue;
+        }
+        unsigned row = from < comm.rank() ? top : top + rows - 1;
+        std::vector<size_t> order(requests.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        ca.rng.shuffle(order);
+        replies[from].assign(requests.size(), 0);
+        for (size_t i : order) {
+            CellPosition c(row, requests[i].col);
+            Cell &target = ca.cell(c);
+            if (!(target.type & EmptyCells)) {
+                continue;
+            }
+            target.type = target.type == Smoke ? PersonWithSmoke :
+                target.type == Exit ? PersonAtExit : Person;
+            target.smoke_exposed = requests[i].smoke_exposed;
+            ca.tile(c).agents++;
+            ca.tile(c).dirty = true;
+            replies[from][i] = 1;
+        }
+    }
+
+    // Accepted people leave their cells
+    std::vector<Buffer> answers = comm.exchange(replies);
+    for (unsigned to = 0; to < comm.size(); to++) {
+        for (size_t i = 0; i < answers[to].size(); i++) {
+            if (!answers[to][i]) {
+                continue;
+            }
+            CellPosition c = pending[to][i];
+            Cell &source = ca.cell(c);
+            source.type = source.type == Person ? Empty : Smoke;
+            source.smoke_exposed = 0;
+            ca.tile(c).agents--;
+            ca.tile(c).dirty = true;
+            ca.stat.moves += 1;
+        }
+    }
+}
+
+/** Serialise statistics of a band. */
+static Buffer serialise(const Statistics &stat) {
+    std::ostringstream out(std::ios::binary);
+    double counters[] = {
+        stat.time, stat.smoke_exposed, stat.moves, stat.evac_time,
+        stat.max_smoke_exposed, (double) stat.stranded
+    };
+    out.write(reinterpret_cast<const char *>(counters), sizeof(counters));
+    stat.person_evac.write(out);
+    std::string s = out.str();
+    return Buffer(s.begin(), s.end());
+}
+
+/** Add statistics of a band to the statistics of the run. */
+static void deserialise(const Buffer &buffer, Statistics &stat) {
+    std::istringstream in(std::string(buffer.begin(), buffer.end()),
+        std::ios::binary);
+    double counters[6];
+    Accumulator person_evac;
+    in.read(reinterpret_cast<char *>(counters), sizeof(counters));
+    person_evac.read(in);
+    if (!in) {
+        throw std::runtime_error("invalid domain result");
+    }
+    stat.time = std::max(stat.time, counters[0]);
+    stat.smoke_exposed += counters[1];
+    stat.moves += counters[2];
+    stat.evac_time += counters[3];
+    stat.max_smoke_exposed = std::max(stat.max_smoke_exposed, counters[4]);
+    stat.stranded += (int) counters[5];
+    stat.person_evac.merge(person_evac);
+}
+
+Statistics Domain::run(const CA &model, unsigned domains) {
+    if (domains == 0 || domains > model.height) {
+        throw std::invalid_argument("more domains than rows");
+    }
+    if (model.reachable.empty()) {
+        // Bands cannot tell the regions that reach an exit apart
+        CA labelled = model.copy();
+        labelled.label_regions();
+        return run(labelled, domains);
+    }
+
+    // A message holds at most one row of distances or requests
+    ShmCommunicator comm(domains, 8 * (size_t) model.width + 64, 1 << 20);
+
+    // Buffered output would be flushed by every worker
+    std::cout.flush();
+    std::cerr.flush();
+    std::vector<pid_t> pids;
+    auto kill_all = [&pids]() {
+        for (pid_t p : pids) {
+            if (p > 0) {
+                kill(p, SIGKILL);
+                waitpid(p, nullptr, 0);
+            }
+        }
+    };
+    for (unsigned d = 0; d < domains; d++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int code = EXIT_SUCCESS;
+            try {
+                comm.attach(d);
+                Domain domain(model, comm);
+                while (domain.evolve());
+                comm.put_result(serialise(domain.stat()));
+            }
+            catch (std::exception &e) {
+                std::cerr << "Error: domain " << d << ": " << e.what()
+                    << std::endl;
+                code = EXIT_FAILURE;
+            }
+            _exit(code);
+        }
+        if (pid < 0) {
+            kill_all();
+            throw std::runtime_error("could not fork domain worker");
+        }
+        pids.push_back(pid);
+    }
+
+    // A failed worker leaves the others waiting at a barrier
+    size_t running = pids.size();
+    bool failed = false;
+    while (running > 0) {
+        bool reaped = false;
+        for (pid_t &p : pids) {
+            int status;
+            if (p > 0 && waitpid(p, &status, WNOHANG) == p) {
+                p = 0;
+                running--;
+                reaped = true;
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    failed = true;
+                    kill_all();
+                    running = 0;
+                    break;
+                }
+            }
+        }
+        if (!reaped && running > 0) {
+            usleep(1000);
+        }
+    }
+    if (failed) {
+        throw std::runtime_error("domain worker failed");
+    }
+
+    Statistics stat;
+    stat.pedestrians = model.stat.pedestrians;
+    for (unsigned d = 0; d < domains; d++) {
+        deserialise(comm.result(d), stat);
+    }
+    return stat;
+}
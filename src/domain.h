@@ -0,0 +1,103 @@
+/**
+ * @file domain.h
+ * Domain decomposition interface.
+ */
+
+#ifndef __domain_h
+#define __domain_h
+
+#include <vector>
+
+#include "evacuation.h"
+#include "communicator.h"
+
+namespace Evacuation {
+
+/**
+ * Row band of a CA owned by one worker process.
+ *
+ * The model is split into bands of rows, one per worker. A band keeps a
+ * one-row halo of each neighbouring band, refreshed by exchanges through
+ * the communicator. Within a step:
+ *  - halo cell types are exchanged and the owned cells are scanned as in
+ *    CA::evolve() (smoke, people leaving at exits);
+ *  - the exit field is solved by block iteration: every band runs a
+ *    Dijkstra seeded by its exits and by its halo distances, then bands
+ *    swap their border distances, until no halo distance changes
+ *    anywhere (the fixed point is the exact global field);
+ *  - people move in random order within their band; a move into a halo
+ *    row is a migration request, accepted by the owner of the cell
+ *    after its own moves if the cell is still free, otherwise the person
+ *    stays.
+ * Apart from the deferred migrations, a step follows the sequential
+ * update with the default solver; --solver, --update and exit blocking
+ * do not apply. Regions are labelled on the whole model, so people with
+ * no exit to reach are stranded as in CA::evolve(), and the run ends
+ * once only they are left or the watchdog, fed by all bands, fires.
+ */
+class Domain {
+public:
+    /**
+     * Take the band of the calling worker from a populated model.
+     * @param model whole model (each worker keeps its band only)
+     * @param comm communicator of the workers
+     * @throw invalid_argument if the model has fewer rows than workers
+     */
+    Domain(const CA &model, Communicator &comm);
+
+    /**
+     * Apply the transition function on the band (collective).
+     * @return false if there are no people to evacuate in any band, or
+     * after CA::stall_steps steps without progress in all of them
+     */
+    bool evolve();
+
+    /** @return statistics of the band */
+    const Statistics &stat() const { return ca.stat; }
+
+    /**
+     * Evolve a populated model to the end on forked worker processes.
+     * @param model populated model
+     * @param domains number of workers (bands)
+     * @return statistics of the run
+     * @throw runtime_error if a worker failed
+     */
+    static Statistics run(const CA &model, unsigned domains);
+
+private:
+    /// Communicator of the workers
+    Communicator &comm;
+    /// First owned row in model coordinates
+    unsigned first;
+    /// Number of owned rows
+    unsigned rows;
+    /// Halo rows above the owned rows (0 or 1)
+    unsigned top;
+    /// Halo rows below the owned rows (0 or 1)
+    unsigned bottom;
+    /// Owned rows and halos
+    CA ca;
+    /// Owned exit cells
+    std::vector<CellPosition> exits;
+
+    /** @return rank of the band owning a local halo row */
+    unsigned neighbour(unsigned row) const;
+
+    /** @return true if a local row is a halo row */
+    bool halo(unsigned row) const {
+        return row < top || row >= top + rows;
+    }
+
+    /** Exchange cell types of the border rows. */
+    void exchange_types();
+
+    /** Solve the exit field over all bands. */
+    void solve();
+
+    /** Move people of the band, migrating those leaving it. */
+    void move(std::vector<CellPosition> &people);
+};
+
+} // end of namespace
+
+#endif
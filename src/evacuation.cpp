@@ -13,24 +13,58 @@
 #include <cassert>
 
 #include <climits>
+#include <cmath>
+#include <limits>
 #include <queue>
 #include <sstream>
+#include <fstream>
+#include <functional>
 
 #include "evacuation.h"
 #include "bitmap.h"
+#include "mapfile.h"
+#include "checkpoint.h"
+#include "hierarchy.h"
+#include "compact.h"
+#include "pool.h"
+#include "wavefront.h"
+#include "smoke.h"
 
 #define shuffle(arr) \
-    std::random_shuffle(arr.begin(), arr.end())
+    rng.shuffle(arr)
 
-#define RAND (((double) rand()) / (RAND_MAX))
+#define RAND (rng.uniform())
 #define PROB(val) val > RAND
+#define PROB_OF(random, val) val > random.uniform()
 
 using namespace Evacuation;
 
+/// Steps ahead the evacuation time histogram is sized for.
+static constexpr double evac_horizon = 1024;
+
+/// Exit distance of no people yet.
+static constexpr double infinity = std::numeric_limits<double>::infinity();
+
 CA::CA(unsigned height, unsigned width) :
     height{height}, width{width},
-    cells(height, std::vector<Cell>(width))
-{}
+    tiles_wide{(width + tile_size - 1) >> tile_bits},
+    tiles(tiles_wide * ((height + tile_size - 1) >> tile_bits)),
+    stalled{0}, closest{infinity}, remaining{0}, smoke_count{0}, epoch{0},
+    label_epoch{0}, moves_current{false},
+    solver{DijkstraSolver},
+    update{SequentialUpdate}, update_threads{1}, generation{0},
+    arena{std::make_shared<Arena>()}, smoke_spread{InlineSmoke}
+{
+    // Padding of edge tiles is never walked into
+    cells.resize(tiles.size() << (2 * tile_bits));
+    for (size_t i = 0; i < cells.size(); i++) {
+        CellPosition pos = cell_position(i);
+        if (!cell_check(pos.first, pos.second)) {
+            cells[i].type = Wall;
+        }
+    }
+    select_kernels();
+}
 
 std::vector<CellPosition> CA::cell_neighbourhood(
     size_t row, size_t col, int cell_types
@@ -55,15 +89,92 @@ std::vector<CellPosition> CA::cell_neighbourhood(
     return cell_neighbourhood(position.first, position.second, cell_types);
 }
 
+unsigned CA::count_neighbours(size_t row, size_t col, int cell_types) const {
+    unsigned count = 0;
+    for (int dr = -1; dr <= 1; dr++) {
+        for (int dc = -1; dc <= 1; dc++) {
+            int r = row + dr, c = col + dc;
+            count += (dr != 0 || dc != 0) && cell_check(r, c) &&
+                (cell(r, c).type & cell_types);
+        }
+    }
+    return count;
+}
+
 bool CA::evolve() {
+    // Evacuation times of the coming steps fall into allocated buckets
+    stat.person_evac.reserve(stat.time + evac_horizon);
+    if (smoke_spread != InlineSmoke && !smoke_plane && smoke_count > 0 &&
+        parameters.smoke_spreading_rate > 0)
+    {
+        smoke_plane = std::make_shared<SmokePlane>(
+            *this, Random(rng()), smoke_spread == AheadSmoke);
+    }
+    double evac_time = stat.evac_time;
+    size_t smoke = smoke_count;
+    bool changed = (this->*evolve_kernel)();
+
+    // Blocks the step chained are merged by the step itself
+    arena->reset();
+    if (!changed) {
+        return false;
+    }
+
+    // Watchdog: nobody can make progress any more
+    if (stall(remaining, stat.evac_time != evac_time, smoke_count != smoke)) {
+        stat.stranded = 0;
+        for (auto &t : tiles) {
+            stat.stranded += t.agents;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool CA::stall(double remaining, bool evacuated, bool lengthened) {
+    if (lengthened) {
+        closest = infinity;
+    }
+    if (evacuated || remaining < closest) {
+        closest = remaining;
+        stalled = 0;
+    }
+    else {
+        stalled++;
+    }
+    return stalled >= stall_steps;
+}
+
+template<bool SmokeSpreading, bool Chaos>
+bool CA::evolve_step() {
     bool res = false;
     stat.time += 1;
 
-    std::vector<CellPosition> people;
-    std::vector<CellPosition> smoke_cells;
-    for (size_t row = 0; row < this->height; row++) {
-        for (size_t col = 0; col < this->width; col++) {
-            auto &current = cells[row][col];
+    People people{ArenaAllocator<CellPosition>(*arena)};
+    People smoke_cells{ArenaAllocator<CellPosition>(*arena)};
+    int stranded = 0;
+    for (size_t t = 0; t < tiles.size(); t++) {
+        // Skip tiles without agents and smoke frontier
+        if (!tile_active<SmokeSpreading>(t)) {
+            continue;
+        }
+
+        // People of regions without an exit stay out of the people list
+        auto collect = [&](size_t row, size_t col) {
+            if (tiles[t].unreachable > 0 && !reachable[cell_index(row, col)]) {
+                stranded++;
+            }
+            else {
+                people.push_back(CellPosition(row, col));
+            }
+        };
+        size_t row_from = (t / tiles_wide) << tile_bits;
+        size_t col_from = (t % tiles_wide) << tile_bits;
+        size_t row_to = std::min<size_t>(row_from + tile_size, height);
+        size_t col_to = std::min<size_t>(col_from + tile_size, width);
+        for (size_t row = row_from; row < row_to; row++) {
+        for (size_t col = col_from; col < col_to; col++) {
+            auto &current = cell(row, col);
             switch (current.type) {
                 case PersonAppearance:
                 case Obstacle:
@@ -71,12 +182,18 @@ bool CA::evolve() {
                 case Person:
                 {
                     // propagation of smoke
+                    if (!SmokeSpreading) {
+                        if (current.type == Person) {
+                            collect(row, col);
+                        }
+                        break;
+                    }
                     float smoke_neigh =
-                        cell_neighbourhood(row, col, SmokeCells).size();
+                        count_neighbours(row, col, SmokeCells);
 
                     float neigh =
-                        cell_neighbourhood(row, col, ~(Exit | Wall)).size();
-                    if (PROB( smoke_neigh/ neigh * smoke_spreading_rate)) {
+                        count_neighbours(row, col, ~(Exit | Wall));
+                    if (PROB( smoke_neigh/ neigh * parameters.smoke_spreading_rate)) {
                         smoke_cells.push_back(CellPosition(row, col));
                         /*
                         if (current.type == Obstacle) {
@@ -92,16 +209,13 @@ bool CA::evolve() {
                     }
                     if (current.type == Person) {
                         // remember person position
-                        people.push_back(CellPosition(row, col));
+                        collect(row, col);
                     }
                     break;
                 }
                 case PersonAtExit:
                     // remove people at exits
-                    stat.evac_time += stat.time;
-                    if (stat.max_smoke_exposed < current.smoke_exposed) {
-                        stat.max_smoke_exposed = current.smoke_exposed;
-                    }
+                    evacuate(current, tiles[t]);
                     current.type = Exit;
                     //std::cout << "FIXME when -p 1" << std::endl;
                     break;
@@ -109,18 +223,33 @@ bool CA::evolve() {
                     stat.smoke_exposed += 1;
                     current.smoke_exposed += 1;
                     // remember person position
-                    people.push_back(CellPosition(row, col));
+                    collect(row, col);
                 default:
                     ;
             }
         }
+        }
     }
 
-    // Recompute exit distances
-    recompute_shortest_paths();
+    // Recompute exit distances around the remaining people
+    recompute_shortest_paths(&people);
+    remaining = 0;
+    for (auto &p : people) {
+        remaining += cell(p).exit_distance;
+    }
+
+    // Smoke spreading apart from the people
+    if (!SmokeSpreading && smoke_plane) {
+        smoke_plane->arrivals((unsigned) stat.time, smoke_cells);
+    }
 
     // Propagate smoke
+    if (!smoke_cells.empty()) {
+        smoke_count += smoke_cells.size();
+    }
     for (auto &c : smoke_cells) {
+        tile(c).smoke++;
+        tile(c).dirty = true;
         auto & current = cell(c);
         if (current.type == Obstacle) {
             current.type = ObstacleWithSmoke;
@@ -135,22 +264,26 @@ bool CA::evolve() {
         }
     }
 
-    // Propagate people
+    // Propagate people; the run ends once only stranded people are left
+    stat.stranded = stranded;
     res = !people.empty();
-    shuffle(people);
+    if (update == ParallelUpdate) {
+        move_parallel<Chaos>(people);
+        return res;
+    }
+    if (update == ReservationUpdate) {
+        move_reserved<Chaos>(people);
+        return res;
+    }
+    if (update == LocalUpdate) {
+        order_blocks(people);
+    }
+    else {
+        shuffle(people);
+    }
     for (auto person : people) {
-        auto neighbours = cell_neighbourhood(person);
-        if (!neighbours.empty()) {
-            // non-deterministic choice of the minimum
-            shuffle(neighbours);
-            // find min value
-            CellPosition next_cell = neighbours[0];
-            for (auto c : neighbours) {
-                if (distance(next_cell) > distance(c)) {
-                    next_cell = c;
-                }
-            }
-
+        CellPosition next_cell;
+        if (next_move(person, next_cell, rng)) {
             // distance to the next cell
             int person_distance = distance(person);
             int next_distance = distance(next_cell);
@@ -159,36 +292,332 @@ bool CA::evolve() {
             // move to the cell with lesser exit distance or same distance
             // with some probability
             if (diff >= 1 ||
-                (diff == 0 && PROB(chaos_rate)))
+                (Chaos && diff == 0 && PROB(parameters.chaos_rate)))
             {
-                // move from empty or smoke cell
-                stat.moves += 1;
-                cell(person).type =
-                    cell(person).type == Person ? Empty : Smoke;
-                cell(next_cell).smoke_exposed = cell(person).smoke_exposed;
-                cell(person).smoke_exposed = 0;
-                auto &next_type = cell(next_cell).type;
-                if (next_type == Smoke) {
-                    next_type = PersonWithSmoke;
+                move(person, next_cell);
+            }
+        }
+    }
+
+    return res;
+}
+
+void CA::order_blocks(People &people) {
+    size_t n = people.size();
+    ArenaVector<size_t> blocks((n + order_block - 1) / order_block,
+        ArenaAllocator<size_t>(*arena));
+    for (size_t b = 0; b < blocks.size(); b++) {
+        blocks[b] = b;
+    }
+    shuffle(blocks);
+
+    People ordered{ArenaAllocator<CellPosition>(*arena)};
+    ordered.reserve(n);
+    for (size_t b : blocks) {
+        size_t first = ordered.size();
+        ordered.insert(ordered.end(), people.begin() + b * order_block,
+            people.begin() + std::min(n, (b + 1) * order_block));
+        for (size_t i = ordered.size() - first; i > 1; i--) {
+            std::swap(ordered[first + i - 1], ordered[first + rng.below(i)]);
+        }
+    }
+    people.swap(ordered);
+}
+
+void CA::move(CellPosition person, CellPosition next_cell) {
+    relocate(person, next_cell);
+    account(person, next_cell);
+}
+
+void CA::account(CellPosition person, CellPosition next_cell) {
+    stat.moves += 1;
+    if (tile_index(person) != tile_index(next_cell)) {
+        tile(person).agents--;
+        tile(next_cell).agents++;
+    }
+    tile(person).dirty = true;
+    tile(next_cell).dirty = true;
+}
+
+void CA::relocate(CellPosition person, CellPosition next_cell) {
+    // move from empty or smoke cell
+    cell(person).type =
+        cell(person).type == Person ? Empty : Smoke;
+    cell(next_cell).smoke_exposed = cell(person).smoke_exposed;
+    cell(person).smoke_exposed = 0;
+    auto &next_type = cell(next_cell).type;
+    if (next_type == Smoke) {
+        next_type = PersonWithSmoke;
+    }
+    else if (next_type == Exit) {
+        next_type = PersonAtExit;
+    }
+    else {
+        next_type = Person;
+    }
+}
+
+template<typename Phase>
+void CA::run_chunks(size_t people, const Phase &phase) {
+    size_t chunks = (people + update_chunk - 1) / update_chunk;
+    if (pool && chunks > 1) {
+        for (size_t c = 0; c < chunks; c++) {
+            // Worker i takes the i-th band of chunks, see set_update()
+            pool->submit([&phase, c](unsigned) { phase(c); },
+                c * pool->size() / chunks);
+        }
+        pool->wait();
+    }
+    else {
+        for (size_t c = 0; c < chunks; c++) {
+            phase(c);
+        }
+    }
+}
+
+template<bool Chaos>
+void CA::move_parallel(const People &people) {
+    // Targets picked from the same state (own position = stay)
+    size_t n = people.size();
+    People targets(n, CellPosition(), ArenaAllocator<CellPosition>(*arena));
+    uint64_t base = rng();
+    auto pick = [&](size_t chunk) {
+        Random random;
+        random.seed(base + chunk);
+        size_t end = std::min(n, (chunk + 1) * update_chunk);
+        for (size_t i = chunk * update_chunk; i < end; i++) {
+            CellPosition person = people[i], next_cell;
+            targets[i] = person;
+            if (next_move(person, next_cell, random)) {
+                int diff = distance(person) - distance(next_cell);
+                if (diff >= 1 || (Chaos && diff == 0 &&
+                    PROB_OF(random, parameters.chaos_rate)))
+                {
+                    targets[i] = next_cell;
                 }
-                else if (next_type == Exit) {
-                    next_type = PersonAtExit;
+            }
+        }
+    };
+    run_chunks(n, pick);
+
+    // Group claims by the claimed cell
+    using Claim = std::pair<size_t, size_t>;
+    ArenaVector<Claim> claims{ArenaAllocator<Claim>(*arena)};
+    for (size_t i = 0; i < n; i++) {
+        if (targets[i] != people[i]) {
+            claims.push_back(
+                {targets[i].first * width + targets[i].second, i});
+        }
+    }
+    std::sort(claims.begin(), claims.end());
+
+    // Resolve conflicts
+    for (size_t first = 0, last; first < claims.size(); first = last) {
+        last = first + 1;
+        while (last < claims.size() &&
+            claims[last].first == claims[first].first)
+        {
+            last++;
+        }
+        size_t winner = first;
+        if (last - first > 1) {
+            if (PROB(parameters.friction)) {
+                continue;
+            }
+            winner += rng.below(last - first);
+        }
+        size_t i = claims[winner].second;
+        move(people[i], targets[i]);
+    }
+}
+
+template<bool Chaos>
+void CA::move_reserved(People &people) {
+    // Claims of a step never match a stamp left by an earlier step
+    if (++generation == 0) {
+        for (auto &r : *reservations) {
+            r.store(0, std::memory_order_relaxed);
+        }
+        generation = 1;
+    }
+
+    // Random priority; chunks keep their own random streams
+    shuffle(people);
+    size_t n = people.size();
+    People targets(n, CellPosition(), ArenaAllocator<CellPosition>(*arena));
+    uint64_t base = rng();
+
+    // Claim and move: a claimed cell is touched by its claimant only
+    auto claim = [&](size_t chunk) {
+        Random random;
+        random.seed(base + chunk);
+        size_t end = std::min(n, (chunk + 1) * update_chunk);
+        CellPosition ranked[8];
+        for (size_t i = chunk * update_chunk; i < end; i++) {
+            CellPosition person = people[i];
+            targets[i] = person;
+            int person_distance = distance(person);
+            unsigned count = rank_moves(person, ranked, random);
+            int sideways = -1; // undecided
+            for (unsigned k = 0; k < count; k++) {
+                int diff = person_distance - distance(ranked[k]);
+                if (diff < 0 || (diff == 0 && !Chaos)) {
+                    break;
                 }
-                else {
-                    next_type = Person;
+                if (diff == 0 && sideways < 0) {
+                    sideways = PROB_OF(random, parameters.chaos_rate);
+                }
+                if (diff == 0 && !sideways) {
+                    break;
+                }
+                auto &r = (*reservations)[
+                    ranked[k].first * width + ranked[k].second];
+                uint32_t seen = r.load(std::memory_order_relaxed);
+                if (seen != generation && r.compare_exchange_strong(
+                    seen, generation, std::memory_order_relaxed))
+                {
+                    targets[i] = ranked[k];
+                    break;
                 }
             }
         }
+    };
+    auto relocate_chunk = [&](size_t chunk) {
+        size_t end = std::min(n, (chunk + 1) * update_chunk);
+        for (size_t i = chunk * update_chunk; i < end; i++) {
+            if (targets[i] != people[i]) {
+                relocate(people[i], targets[i]);
+            }
+        }
+    };
+
+    // Moves are only made once all claims are settled, as claims read
+    // the cell types around people
+    run_chunks(n, claim);
+    run_chunks(n, relocate_chunk);
+
+    // Shared counters
+    for (size_t i = 0; i < n; i++) {
+        if (targets[i] != people[i]) {
+            account(people[i], targets[i]);
+        }
     }
+}
 
-    return res;
+/// Lanes of the movement kernel, one per Moore neighbour.
+typedef unsigned Lanes __attribute__((vector_size(8 * sizeof(unsigned))));
+
+/// Moore neighbourhood offsets in lane order.
+static const int lane_row[8] = {-1, 0, 0, 1, -1, -1, 1, 1};
+static const int lane_col[8] = {0, -1, 1, 0, -1, 1, -1, 1};
+/// Lane of a neighbour by its row and column offset (plus one).
+static const int lane_of[3][3] = {{4, 0, 5}, {1, -1, 2}, {6, 3, 7}};
+
+/** @return lane picked uniformly from a non-empty mask with a single draw */
+static inline int pick_lane(unsigned mask, Random &random) {
+    unsigned ties = __builtin_popcount(mask);
+    for (size_t skip = ties > 1 ? random.below(ties) : 0; skip > 0; skip--) {
+        mask &= mask - 1;
+    }
+    return __builtin_ctz(mask);
+}
+
+bool CA::next_move(CellPosition person, CellPosition &next, Random &random) {
+    // Best moves of the solve, unless all of them have been taken since
+    if (moves_current) {
+        unsigned mask = 0;
+        uint32_t best = best_moves[cell_index(person)];
+        for (unsigned m = best & 0xff; m != 0; m &= m - 1) {
+            int lane = __builtin_ctz(m);
+            const Cell &c = cell(person.first + lane_row[lane],
+                person.second + lane_col[lane]);
+            mask |= ((c.type & EmptyCells) != 0) << lane;
+        }
+        if (mask != 0) {
+            int lane = pick_lane(mask, random);
+            next = CellPosition(person.first + lane_row[lane],
+                person.second + lane_col[lane]);
+            return true;
+        }
+    }
+
+    // Gather distances; cells a person cannot enter never win
+    Lanes d;
+    unsigned eligible = 0;
+    for (int i = 0; i < 8; i++) {
+        int r = person.first + lane_row[i], c = person.second + lane_col[i];
+        bool ok = cell_check(r, c) && (cell(r, c).type & EmptyCells);
+        d[i] = ok ? cell(r, c).exit_distance : UINT_MAX;
+        eligible |= ok << i;
+    }
+    if (eligible == 0) {
+        return false;
+    }
+
+    // Horizontal minimum broadcast to every lane
+    Lanes m = d;
+    m = m < __builtin_shuffle(m, Lanes{4, 5, 6, 7, 0, 1, 2, 3}) ?
+        m : __builtin_shuffle(m, Lanes{4, 5, 6, 7, 0, 1, 2, 3});
+    m = m < __builtin_shuffle(m, Lanes{2, 3, 0, 1, 6, 7, 4, 5}) ?
+        m : __builtin_shuffle(m, Lanes{2, 3, 0, 1, 6, 7, 4, 5});
+    m = m < __builtin_shuffle(m, Lanes{1, 0, 3, 2, 5, 4, 7, 6}) ?
+        m : __builtin_shuffle(m, Lanes{1, 0, 3, 2, 5, 4, 7, 6});
+
+    // Uniform choice among the tied minima with a single draw
+    Lanes tie = d == m;
+    unsigned mask = 0;
+    for (int i = 0; i < 8; i++) {
+        mask |= (tie[i] & 1) << i;
+    }
+    int lane = pick_lane(mask & eligible, random);
+    next = CellPosition(person.first + lane_row[lane],
+        person.second + lane_col[lane]);
+    return true;
+}
+
+unsigned CA::rank_moves(
+    CellPosition person, CellPosition *ranked, Random &random) const
+{
+    unsigned count = 0;
+    for (int i = 0; i < 8; i++) {
+        int r = person.first + lane_row[i], c = person.second + lane_col[i];
+        if (cell_check(r, c) && (cell(r, c).type & EmptyCells)) {
+            ranked[count++] = CellPosition(r, c);
+        }
+    }
+
+    // Uniform order, then a stable sort by distance
+    for (unsigned i = count; i > 1; i--) {
+        std::swap(ranked[i - 1], ranked[random.below(i)]);
+    }
+    for (unsigned i = 1; i < count; i++) {
+        CellPosition c = ranked[i];
+        unsigned d = distance(c);
+        unsigned j = i;
+        for (; j > 0 && (unsigned) distance(ranked[j - 1]) > d; j--)
+        {
+            ranked[j] = ranked[j - 1];
+        }
+        ranked[j] = c;
+    }
+    return count;
+}
+
+void CA::evacuate(Cell &cell, Tile &tile) {
+    stat.evac_time += stat.time;
+    stat.person_evac.push(stat.time);
+    if (stat.max_smoke_exposed < cell.smoke_exposed) {
+        stat.max_smoke_exposed = cell.smoke_exposed;
+    }
+    cell.smoke_exposed = 0;
+    tile.agents--;
 }
 
 void CA::add_smoke(int smoke) {
     std::vector<CellPosition> empty_cells;
     for (size_t i = 0; i < this->height; i++) {
         for (size_t j = 0; j < this->width; j++) {
-            if (cells[i][j].type == Empty) {
+            if (cell(i, j).type == Empty) {
                 empty_cells.push_back(CellPosition(i,j));
             }
         }
@@ -203,6 +632,7 @@ void CA::add_smoke(int smoke) {
         cell(empty_cells.back()).type = Smoke;
         empty_cells.pop_back();
     }
+    recount();
 
 }
 
@@ -211,20 +641,25 @@ void CA::add_people(int people_count) {
     stat.pedestrians = people_count;
     std::vector<CellPosition> empty_cells;
     std::vector<CellPosition> empty_priority_cells;
-    // mark all cells with possible person appearance
+    // mark all cells with possible person appearance (but those no exit
+    // can be reached from)
     for (size_t i = 0; i < this->height; i++) {
         for (size_t j = 0; j < this->width; j++) {
-            if (cells[i][j].type == Empty) {
+            if (!reachable.empty() && !reachable[cell_index(i, j)]) {
+                continue;
+            }
+            if (cell(i, j).type == Empty) {
                 empty_cells.push_back(CellPosition(i,j));
             }
-            else if (cells[i][j].type == PersonAppearance) {
+            else if (cell(i, j).type == PersonAppearance) {
                 empty_priority_cells.push_back(CellPosition(i,j));
             }
         }
     }
 
     if (people_count > empty_cells.size() + empty_priority_cells.size()) {
-        throw std::logic_error("cannot have more people than empty cells");
+        throw std::logic_error(
+            "cannot have more people than reachable empty cells");
     }
 
     shuffle(empty_priority_cells);
@@ -239,120 +674,613 @@ void CA::add_people(int people_count) {
         cell(empty_cells.back()).type = Person;
         empty_cells.pop_back();
     }
+    recount();
 }
 
-void CA::recompute_shortest_paths() {
-    // Reset exit distances
-    std::vector<std::vector<double>> distances(
-		this->height, std::vector<double>(this->width)
-	);
+void CA::recompute_shortest_paths(const People *targets) {
+    // Only the Dijkstra solver emits best moves
+    moves_current = false;
 
-	// State distance accruals
-    std::vector<std::vector<double>> accruals(
-		this->height, std::vector<double>(this->width)
-	);
+    // In an empty building the exact solvers reduce to a breadth-first
+    // search
+    if (targets == nullptr &&
+        (solver == DijkstraSolver || solver == CompactSolver) &&
+        Wavefront::solve(*this))
+    {
+        return;
+    }
+    (this->*solve_kernel)(targets);
+}
+
+template<typename Distance, bool SmokePresent>
+void CA::solve(const People *targets) {
+    size_t size = cells.size();
+    if (solve_state.size() != size) {
+        solve_state.assign(size, 0);
+        solve_needed.assign(size, 0);
+        solve_distance.resize(size);
+        best_moves.resize(size);
+        solve_heap.reserve(size);
+        epoch = 0;
+    }
+
+    // Stamps of earlier solves read as unreached
+    if (epoch >= UINT32_MAX / 2 - 1) {
+        std::fill(solve_state.begin(), solve_state.end(), 0);
+        std::fill(solve_needed.begin(), solve_needed.end(), 0);
+        epoch = 0;
+    }
+    epoch++;
+    const uint32_t reached = 2 * epoch, settled = 2 * epoch + 1;
 
-	// Vector of visited states
-    std::vector<std::vector<bool>> visited(
-		this->height, std::vector<bool>(this->width)
-	);
+    // Accrual of each cell type
+    Distance accruals[CellTypes];
+    for (unsigned b = 0; b < CellTypes; b++) {
+        CellType type = (CellType) (1 << b);
+        Distance accrual = 1;
+        if (type & (Person | PersonWithSmoke)) {
+            accrual *= parameters.occupied_distance;
+        }
+        if (SmokePresent && (type & (Smoke | PersonWithSmoke))) {
+            accrual *= parameters.smoke_distance;
+        }
+        accruals[b] = accrual;
+    }
 
-	// Vector of pushed states
-    std::vector<std::vector<bool>> pushed(
-		this->height, std::vector<bool>(this->width)
-	);
+    // Cell types that are considered reachable
+    constexpr int succTypes = WalkableCells;
 
-	// Initialize
-	for (unsigned row = 0; row < this->height; row++) {
-        for (unsigned col = 0; col < this->width; col++) {
-        	// Accrual
-        	double accrual = 1.0;
-        	CellType type = cell(row,col).type;
-            if(type & (Person | PersonWithSmoke)) {
-                accrual *= occupied_distance;
+    // Cells whose distances the targets read (the search stops once
+    // all of them are settled)
+    size_t remaining = 0;
+    if (targets != nullptr) {
+        for (auto &t : *targets) {
+            for (int dr = -1; dr <= 1; dr++) {
+                for (int dc = -1; dc <= 1; dc++) {
+                    int r = t.first + dr, c = t.second + dc;
+                    if (!cell_check(r, c)) {
+                        continue;
+                    }
+                    size_t i = cell_index(r, c);
+                    if ((cells[i].type & succTypes) &&
+                        solve_needed[i] != epoch)
+                    {
+                        solve_needed[i] = epoch;
+                        remaining++;
+                    }
+                }
             }
-            if(type & (Smoke | PersonWithSmoke)) {
-                accrual *= smoke_distance;
+            best_moves[cell_index(t)] = UINT32_MAX;
+        }
+    }
+    else {
+        std::fill(best_moves.begin(), best_moves.end(), UINT32_MAX);
+    }
+
+    // Tentative distances are written straight into the exit field
+    auto &heap = solve_heap;
+    auto later = [](const HeapEntry &a, const HeapEntry &b) {
+        return a.first > b.first;
+    };
+    heap.clear();
+    for (auto &es : exit_states) {
+        size_t i = cell_index(es);
+        tentative(i, Distance()) = 0;
+        cells[i].exit_distance = 0;
+        solve_state[i] = reached;
+        heap.push_back(HeapEntry(0, i));
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+
+    // Process all states
+    bool complete = false;
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        uint32_t i = heap.back().second;
+        heap.pop_back();
+        if (solve_state[i] == settled) {
+            continue;
+        }
+        solve_state[i] = settled;
+        complete = targets != nullptr && solve_needed[i] == epoch &&
+            --remaining == 0;
+
+        // Successors pay the accrual of the cell they step from
+        unsigned exit_distance = cells[i].exit_distance;
+        Distance next_distance = tentative(i, Distance())
+            + accruals[__builtin_ctz(cells[i].type)];
+
+        // Neighbours within the tile are at fixed offsets
+        unsigned inner_row = i >> tile_bits & (tile_size - 1);
+        unsigned inner_col = i & (tile_size - 1);
+        bool inner = inner_row - 1 < tile_size - 2 &&
+            inner_col - 1 < tile_size - 2;
+        CellPosition here = inner ? CellPosition() : cell_position(i);
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                size_t j;
+                if (dr == 0 && dc == 0) {
+                    continue;
+                }
+                if (inner) {
+                    j = i + dr * (int) tile_size + dc;
+                }
+                else {
+                    int r = here.first + dr, c = here.second + dc;
+                    if (!cell_check(r, c)) {
+                        continue;
+                    }
+                    j = cell_index(r, c);
+                }
+                CellType type = cells[j].type;
+
+                // Cells settle by distance, so the first settled
+                // neighbours of a person are its best moves
+                if ((type & (Person | PersonWithSmoke)) &&
+                    exit_distance <= UINT32_MAX >> 8)
+                {
+                    uint32_t &best = best_moves[j];
+                    uint32_t key = exit_distance << 8;
+                    if (key < (best & ~0xffu)) {
+                        best = key;
+                    }
+                    if (key == (best & ~0xffu)) {
+                        best |= 1 << lane_of[1 - dr][1 - dc];
+                    }
+                }
+
+                if (complete || !(type & succTypes) ||
+                    solve_state[j] == settled ||
+                    (solve_state[j] == reached &&
+                     next_distance >= tentative(j, Distance())))
+                {
+                    continue;
+                }
+                tentative(j, Distance()) = next_distance;
+                cells[j].exit_distance = (unsigned) next_distance;
+                solve_state[j] = reached;
+                heap.push_back(HeapEntry(next_distance, j));
+                std::push_heap(heap.begin(), heap.end(), later);
             }
-            accruals[row][col] = accrual;
+        }
+        if (complete) {
+            break;
+        }
+    }
 
-            // Distance
-            distances[row][col] = (double)UINT_MAX;
+    // Best moves hold once every cell around the people is settled;
+    // otherwise moves fall back to stale or infinite distances
+    moves_current = targets == nullptr || complete;
 
-            // Visited and pushed
-            visited[row][col] = false;
-            pushed[row][col] = false;
+    // A whole field leaves no stale distances behind
+    if (targets == nullptr) {
+        for (size_t i = 0; i < size; i++) {
+            if (solve_state[i] < reached) {
+                cells[i].exit_distance = UINT_MAX;
+            }
         }
     }
+}
 
-    // Vector of unprocessed states
-    std::vector<CellPosition> unprocessed;
+template<typename Distance, bool SmokePresent>
+void CA::solve_exits(const People *targets) {
+    constexpr unsigned k = exit_labels;
+    constexpr unsigned none = UINT_MAX;
+    constexpr int succTypes = WalkableCells;
+    size_t size = (size_t) height * width;
+    if (label_stamp.size() != size || labels.size() != size * k) {
+        labels.assign(size * k, ExitLabel{none, UINT_MAX});
+        label_stamp.assign(size, 0);
+        label_count.assign(size, 0);
+        label_needed.assign(size, 0);
+        label_heap.reserve(size * k);
+        label_epoch = 0;
+    }
 
-    // Push exit states
-    for(auto es: exit_states) {
-    	unprocessed.push_back(es);
-    	distances[es.first][es.second] = 0.0;
-    	pushed[es.first][es.second] = true;
+    // Stamps of earlier solves read as unset
+    if (label_epoch == UINT32_MAX) {
+        std::fill(label_stamp.begin(), label_stamp.end(), 0);
+        std::fill(label_needed.begin(), label_needed.end(), 0);
+        label_epoch = 0;
     }
+    const uint32_t stamp = ++label_epoch;
 
-    // Process all states
-    while(!unprocessed.empty()) {
-		// Find unprocessed state with minimum exit distance
-		CellPosition current = unprocessed[0];
-		int min = 0;
-		double current_distance = distances[current.first][current.second];
-		for(int i = 1; i < unprocessed.size(); i++) {
-			CellPosition cp = unprocessed[i];
-            double d = distances[cp.first][cp.second];
-            if(d < current_distance) {
-                min = i;
-                current = cp;
-                current_distance = d;
-			}
-		}
-
-		// Visit minimum
-        unprocessed[min] = unprocessed.back();
-		unprocessed.pop_back();
-		visited[current.first][current.second] = true;
-
-        // Cell types that are considered reachable
-        constexpr int succTypes =  Empty | Exit | Person | Smoke
-           | PersonAppearance | PersonAtExit | PersonWithSmoke;
-
-        // Generate successors
-        std::vector<CellPosition> successors;
-        successors = cell_neighbourhood(current, succTypes);
-
-        // Compute successor distance
-        double accrual = accruals[current.first][current.second];
-        double next_distance = current_distance + accrual;
-
-        // Process all successors
-        for(CellPosition successor: successors) {
-            // Skip processed successors
-            unsigned r = successor.first, c = successor.second;
-            if(!visited[r][c]) {
-                if(next_distance < distances[r][c]) {
-                    distances[r][c] = next_distance;
-                    if(!pushed[r][c]) {
-                    	unprocessed.push_back(successor);
-                    	pushed[r][c] = true;
+    // Cells whose labels the targets read (the search stops once all
+    // of them are settled)
+    size_t remaining = 0;
+    if (targets != nullptr) {
+        for (auto &t : *targets) {
+            for (int dr = -1; dr <= 1; dr++) {
+                for (int dc = -1; dc <= 1; dc++) {
+                    int r = t.first + dr, c = t.second + dc;
+                    size_t i = (size_t) r * width + c;
+                    if (cell_check(r, c) && (cell(r, c).type & succTypes)
+                        && label_needed[i] != stamp)
+                    {
+                        label_needed[i] = stamp;
+                        remaining++;
+                    }
+                }
+            }
+        }
+    }
+
+    auto &heap = label_heap;
+    auto later = [](const LabelEntry &a, const LabelEntry &b) {
+        return a.distance > b.distance;
+    };
+    auto push = [&](double distance, size_t i, unsigned exit) {
+        heap.push_back(LabelEntry{distance, (uint32_t) i, exit});
+        std::push_heap(heap.begin(), heap.end(), later);
+    };
+
+    // Labels a cell still lacks
+    auto open = [&](size_t i, unsigned exit) {
+        if (label_stamp[i] != stamp) {
+            return true;
+        }
+        if (label_count[i] == k) {
+            return false;
+        }
+        for (unsigned l = 0; l < label_count[i]; l++) {
+            if (labels[i * k + l].exit == exit) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    heap.clear();
+    for (unsigned e = 0; e < exits.size(); e++) {
+        for (auto &es : exits[e]) {
+            push(0, (size_t) es.first * width + es.second, e);
+        }
+    }
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), later);
+        LabelEntry top = heap.back();
+        heap.pop_back();
+        size_t i = top.cell;
+        if (!open(i, top.exit)) {
+            continue;
+        }
+
+        // Labels are written as they settle; the first one of a solve
+        // clears those of earlier solves
+        ExitLabel *l = &labels[i * k];
+        if (label_stamp[i] != stamp) {
+            label_stamp[i] = stamp;
+            label_count[i] = 0;
+            std::fill(l, l + k, ExitLabel{none, UINT_MAX});
+        }
+        unsigned d = top.distance < (double) UINT_MAX ?
+            (unsigned) top.distance : UINT_MAX;
+        l[label_count[i]] = ExitLabel{top.exit, d};
+        if (label_count[i] == 0) {
+            cell(i / width, i % width).exit_distance = d;
+        }
+        if (++label_count[i] == k && targets != nullptr &&
+            label_needed[i] == stamp && --remaining == 0)
+        {
+            break;
+        }
+
+        // Successors pay the accrual of the cell they step from
+        unsigned row = i / width, col = i % width;
+        Distance accrual = 1;
+        CellType type = cell(row, col).type;
+        if (type & (Person | PersonWithSmoke)) {
+            accrual *= parameters.occupied_distance;
+        }
+        if (SmokePresent && (type & (Smoke | PersonWithSmoke))) {
+            accrual *= parameters.smoke_distance;
+        }
+        double next = top.distance + accrual;
+        for (int lane = 0; lane < 8; lane++) {
+            int r = row + lane_row[lane], c = col + lane_col[lane];
+            if (!cell_check(r, c) || !(cell(r, c).type & succTypes)) {
+                continue;
+            }
+            size_t j = (size_t) r * width + c;
+            if (open(j, top.exit)) {
+                push(next, j, top.exit);
+            }
+        }
+    }
+
+    // A whole field leaves no stale labels behind
+    if (targets == nullptr) {
+        for (size_t i = 0; i < size; i++) {
+            if (label_stamp[i] != stamp) {
+                std::fill(&labels[i * k], &labels[i * k] + k,
+                    ExitLabel{none, UINT_MAX});
+                cell(i / width, i % width).exit_distance = UINT_MAX;
+            }
+        }
+    }
+}
+
+const ExitLabel *CA::nearest_exits(unsigned row, unsigned col) const {
+    if (labels.empty()) {
+        return nullptr;
+    }
+    return &labels[((size_t) row * width + col) * exit_labels];
+}
+
+void CA::group_exits() {
+    // Index of the exit of each exit cell (-1 = not yet grouped)
+    std::vector<std::vector<int>> group(height, std::vector<int>(width, -2));
+    for (auto &es : exit_states) {
+        group[es.first][es.second] = -1;
+    }
+
+    exits.clear();
+    for (auto &es : exit_states) {
+        if (group[es.first][es.second] != -1) {
+            continue;
+        }
+        int id = exits.size();
+        exits.emplace_back();
+        std::vector<CellPosition> stack{es};
+        group[es.first][es.second] = id;
+        while (!stack.empty()) {
+            CellPosition c = stack.back();
+            stack.pop_back();
+            exits[id].push_back(c);
+            for (int dr = -1; dr <= 1; dr++) {
+                for (int dc = -1; dc <= 1; dc++) {
+                    int r = c.first + dr, col = c.second + dc;
+                    if (cell_check(r, col) && group[r][col] == -1) {
+                        group[r][col] = id;
+                        stack.push_back(CellPosition(r, col));
                     }
                 }
             }
         }
     }
+}
+
+void CA::label_regions() {
+    // Region of each walkable cell by cell index (UINT32_MAX = none yet)
+    std::vector<uint32_t> region(cells.size(), UINT32_MAX);
+    reachable.assign(cells.size(), 0);
+    unreachable_regions = Unreachable();
+    for (auto &t : tiles) {
+        t.unreachable = 0;
+    }
+
+    uint32_t regions = 0;
+    std::vector<CellPosition> members;
+    for (unsigned row = 0; row < height; row++) {
+        for (unsigned col = 0; col < width; col++) {
+            size_t i = cell_index(row, col);
+            if (!(cells[i].type & WalkableCells) || region[i] != UINT32_MAX) {
+                continue;
+            }
+
+            // Flood the region breadth-first
+            members.assign(1, CellPosition(row, col));
+            region[i] = regions;
+            bool exit = false;
+            for (size_t head = 0; head < members.size(); head++) {
+                CellPosition c = members[head];
+                exit |= (cell(c).type & (Exit | PersonAtExit)) != 0;
+                for (int dr = -1; dr <= 1; dr++) {
+                    for (int dc = -1; dc <= 1; dc++) {
+                        int r = c.first + dr, cl = c.second + dc;
+                        if (!cell_check(r, cl)) {
+                            continue;
+                        }
+                        size_t j = cell_index(r, cl);
+                        if ((cells[j].type & WalkableCells) &&
+                            region[j] == UINT32_MAX)
+                        {
+                            region[j] = regions;
+                            members.push_back(CellPosition(r, cl));
+                        }
+                    }
+                }
+            }
+            regions++;
 
-    // Store final result
-    for(unsigned row = 0; row < this->height; row++) {
-        for(unsigned col = 0; col < this->width; col++) {
-        	cell(row,col).exit_distance = distances[row][col];
+            if (exit) {
+                for (auto &c : members) {
+                    reachable[cell_index(c)] = 1;
+                }
+                continue;
+            }
+            unreachable_regions.regions++;
+            unreachable_regions.cells += members.size();
+            for (auto &c : members) {
+                CellType type = cell(c).type;
+                unreachable_regions.spawns += type == PersonAppearance;
+                unreachable_regions.people +=
+                    (type & (Person | PersonWithSmoke)) != 0;
+                tile(c).unreachable++;
+            }
+        }
+    }
+}
+
+void CA::disable_exit(unsigned exit) {
+    if (exit >= exits.size()) {
+        throw std::invalid_argument("unknown exit " + std::to_string(exit));
+    }
+    if (exits[exit].empty()) {
+        return;
+    }
+    size_t open = 0;
+    for (auto &e : exits) {
+        open += !e.empty();
+    }
+    if (open == 1) {
+        throw std::logic_error("cannot block the last open exit");
+    }
+
+    // Wall the exit up; people standing in it are already out
+    std::vector<CellPosition> walled;
+    walled.swap(exits[exit]);
+    for (auto &c : walled) {
+        Cell &current = cell(c);
+        if (current.type == PersonAtExit) {
+            evacuate(current, tile(c));
+        }
+        current.type = Wall;
+        tile(c).dirty = true;
+    }
+    exit_states.clear();
+    for (auto &e : exits) {
+        exit_states.insert(exit_states.end(), e.begin(), e.end());
+    }
+    closest = infinity;
+    label_regions();
+    if (graph) {
+        // Exits are part of the tile graph layout
+        graph = std::make_shared<TileGraph>(*this);
+        for (auto &t : tiles) {
+            t.dirty = true;
+        }
+    }
+    if (compact) {
+        compact = std::make_shared<CellGraph>(*this);
+    }
+
+    if (labels.empty()) {
+        recompute_shortest_paths();
+        return;
+    }
+
+    // Shortest way on from the walled cells to another exit (0 if the
+    // labels do not tell)
+    moves_current = false;
+    constexpr unsigned k = exit_labels;
+    uint64_t onward = UINT_MAX;
+    for (auto &c : walled) {
+        ExitLabel *l = &labels[(c.first * width + c.second) * k];
+        for (unsigned j = 0; j < k; j++) {
+            if (l[j].exit == UINT_MAX) {
+                onward = 0;
+            }
+            else if (l[j].exit != exit) {
+                onward = std::min<uint64_t>(onward, l[j].distance);
+            }
+        }
+    }
+
+    // Fall back to the next nearest exit. A path through the walled
+    // cells is at least as long as the distance to them plus the way
+    // on, so only labels at least that long may run through them.
+    size_t size = labels.size() / k;
+    std::vector<uint8_t> unsure(size, 0);
+    bool exact = true;
+    for (size_t i = 0; i < size; i++) {
+        ExitLabel *l = &labels[i * k];
+        unsigned kept = 0;
+        uint64_t bound = UINT64_MAX;
+        for (unsigned j = 0; j < k; j++) {
+            if (l[j].exit == exit) {
+                bound = l[j].distance + onward;
+            }
+            else {
+                l[kept++] = l[j];
+            }
+        }
+        for (unsigned j = 0; j < kept; j++) {
+            unsure[i] |= l[j].distance >= bound;
+        }
+        exact = exact && !unsure[i];
+        for (; kept < k; kept++) {
+            l[kept] = ExitLabel{UINT_MAX, UINT_MAX};
+        }
+        cell(i / width, i % width).exit_distance = l[0].distance;
+    }
+    for (auto &c : walled) {
+        ExitLabel *l = &labels[(c.first * width + c.second) * k];
+        std::fill(l, l + k, ExitLabel{UINT_MAX, UINT_MAX});
+        cell(c).exit_distance = UINT_MAX;
+    }
+    if (exact) {
+        return;
+    }
+
+    // Unsure cells are solved again from the cells around them: every
+    // path from an exit to them enters them from a cell whose nearest
+    // label holds
+    auto accrual = [this](size_t i) {
+        CellType type = cell(i / width, i % width).type;
+        double a = 1;
+        if (type & (Person | PersonWithSmoke)) {
+            a *= parameters.occupied_distance;
+        }
+        if (type & (Smoke | PersonWithSmoke)) {
+            a *= parameters.smoke_distance;
+        }
+        return a;
+    };
+    struct Entry {
+        double distance;
+        size_t cell;
+        unsigned exit;
+        bool operator>(const Entry &other) const {
+            return distance > other.distance;
+        }
+    };
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    for (size_t i = 0; i < size; i++) {
+        if (!unsure[i]) {
+            continue;
+        }
+        std::fill(&labels[i * k], &labels[i * k] + k,
+            ExitLabel{UINT_MAX, UINT_MAX});
+        Cell &current = cell(i / width, i % width);
+        current.exit_distance = UINT_MAX;
+        if (!(current.type & WalkableCells)) {
+            continue;
+        }
+        for (int lane = 0; lane < 8; lane++) {
+            int r = i / width + lane_row[lane], c = i % width + lane_col[lane];
+            size_t j = (size_t) r * width + c;
+            if (cell_check(r, c) && !unsure[j] &&
+                (cell(r, c).type & WalkableCells) &&
+                labels[j * k].exit != UINT_MAX)
+            {
+                heap.push(Entry{labels[j * k].distance + accrual(j), i,
+                    labels[j * k].exit});
+            }
+        }
+    }
+    while (!heap.empty()) {
+        Entry top = heap.top();
+        heap.pop();
+        size_t i = top.cell;
+        if (labels[i * k].exit != UINT_MAX) {
+            continue;
+        }
+        unsigned d = top.distance < UINT_MAX ?
+            (unsigned) top.distance : UINT_MAX;
+        labels[i * k] = ExitLabel{top.exit, d};
+        cell(i / width, i % width).exit_distance = d;
+        double next = top.distance + accrual(i);
+        for (int lane = 0; lane < 8; lane++) {
+            int r = i / width + lane_row[lane], c = i % width + lane_col[lane];
+            size_t j = (size_t) r * width + c;
+            if (cell_check(r, c) && unsure[j] &&
+                (cell(r, c).type & WalkableCells) &&
+                labels[j * k].exit == UINT_MAX)
+            {
+                heap.push(Entry{next, j, top.exit});
+            }
         }
     }
 }
 
 CA CA::load(const std::string &filename) {
+    // Native maps carry their exits and static field
+    if (MapFile::is_native(filename)) {
+        return MapFile::load(filename);
+    }
+
     // Load from image
     CA ca = Bitmap::load(filename);
 
@@ -366,55 +1294,433 @@ CA CA::load(const std::string &filename) {
     }
 
     // Resolve distances
+    ca.group_exits();
+    ca.label_regions();
+    ca.recount();
     ca.recompute_shortest_paths();
 
     // Success
     return ca;
 }
 
-CA CA::copy() {
+CA CA::copy() const {
 	CA cpy = CA(height, width);
 	cpy.cells = cells;
 	cpy.exit_states = exit_states;
+	cpy.exits = exits;
+	cpy.labels = labels;
+	cpy.reachable = reachable;
+	cpy.unreachable_regions = unreachable_regions;
 	cpy.stat = stat;
+	cpy.stalled = stalled;
+	cpy.closest = closest;
+	cpy.rng = rng;
+	cpy.tiles = tiles;
+	cpy.smoke_count = smoke_count;
+	cpy.solver = solver;
+	if (graph) {
+	    cpy.graph = std::make_shared<TileGraph>(*graph);
+	}
+	if (compact) {
+	    cpy.compact = std::make_shared<CellGraph>(*compact);
+	}
+	cpy.smoke_spread = smoke_spread;
+	cpy.set_params(parameters);
+	cpy.set_update(update, update_threads);
 	return cpy;
 }
 
+void CA::set_params(const ModelParams &params) {
+    parameters = params;
+    select_kernels();
+}
+
+void CA::select_kernels() {
+    bool smoke = smoke_count > 0;
+    bool spreading = smoke && parameters.smoke_spreading_rate > 0 &&
+        smoke_spread == InlineSmoke;
+    bool chaos = parameters.chaos_rate > 0;
+    if (spreading) {
+        evolve_kernel = chaos ?
+            &CA::evolve_step<true, true> : &CA::evolve_step<true, false>;
+    }
+    else {
+        evolve_kernel = chaos ?
+            &CA::evolve_step<false, true> : &CA::evolve_step<false, false>;
+    }
+
+    if (solver == HierarchicalSolver) {
+        solve_kernel = &CA::solve_hierarchical;
+        return;
+    }
+
+    // Integral accruals keep the whole solve in integer arithmetic
+    auto integral = [](float f) { return f >= 1 && f == (unsigned) f; };
+    bool exact = integral(parameters.occupied_distance) &&
+        integral(parameters.smoke_distance);
+    if (solver == MultiExitSolver) {
+        if (exact) {
+            solve_kernel = smoke ?
+                &CA::solve_exits<unsigned, true> :
+                &CA::solve_exits<unsigned, false>;
+        }
+        else {
+            solve_kernel = smoke ?
+                &CA::solve_exits<double, true> :
+                &CA::solve_exits<double, false>;
+        }
+    }
+    else if (solver == CompactSolver) {
+        if (exact) {
+            solve_kernel = smoke ?
+                &CA::solve_compact<unsigned, true> :
+                &CA::solve_compact<unsigned, false>;
+        }
+        else {
+            solve_kernel = smoke ?
+                &CA::solve_compact<double, true> :
+                &CA::solve_compact<double, false>;
+        }
+    }
+    else if (exact) {
+        solve_kernel = smoke ?
+            &CA::solve<unsigned, true> : &CA::solve<unsigned, false>;
+    }
+    else {
+        solve_kernel = smoke ?
+            &CA::solve<double, true> : &CA::solve<double, false>;
+    }
+}
+
+void CA::set_solver(Solver solver) {
+    if (solver == this->solver) {
+        return;
+    }
+    this->solver = solver;
+    if (solver == HierarchicalSolver && !graph) {
+        graph = std::make_shared<TileGraph>(*this);
+    }
+    if (solver == CompactSolver && !compact) {
+        compact = std::make_shared<CellGraph>(*this);
+    }
+    if (solver != MultiExitSolver) {
+        labels.clear();
+    }
+    select_kernels();
+    recompute_shortest_paths();
+}
+
+void CA::set_smoke(SmokeSpread spread) {
+    smoke_spread = spread;
+    smoke_plane.reset();
+    select_kernels();
+}
+
+void CA::set_update(Update update, unsigned threads) {
+    this->update = update;
+    update_threads = std::max(threads, 1u);
+    pool.reset();
+    if ((update == ParallelUpdate || update == ReservationUpdate) &&
+        update_threads > 1)
+    {
+        // The models a thread evolves one after another (replicates)
+        // share its pool
+        static thread_local std::shared_ptr<ThreadPool> shared;
+        if (!shared || shared->size() != update_threads) {
+            shared = std::make_shared<ThreadPool>(update_threads);
+        }
+        pool = shared;
+    }
+    reservations.reset();
+    if (update == ReservationUpdate) {
+        reservations =
+            std::make_shared<Plane<std::atomic<uint32_t>>>(
+                (size_t) height * width);
+        generation = 0;
+    }
+
+    // Workers touch the cells they read first
+    if (pool) {
+        Placement::spread(cells.data(), cells.size() * sizeof(Cell), *pool);
+        if (reservations) {
+            Placement::spread(reservations->data(),
+                reservations->size() * sizeof(std::atomic<uint32_t>), *pool);
+        }
+    }
+}
+
+void CA::solve_hierarchical(const People *targets) {
+    graph->solve(*this, targets);
+}
+
+template<typename Distance, bool SmokePresent>
+void CA::solve_compact(const People *targets) {
+    compact->solve<Distance, SmokePresent>(*this, targets);
+}
+
+void CA::recount() {
+    // Cells that are or may become smoke
+    constexpr int smokeable =
+        SmokeCells | PersonAppearance | Obstacle | Empty | Person;
+
+    smoke_count = 0;
+    smoke_plane.reset();
+    for (auto &t : tiles) {
+        t = Tile();
+    }
+    for (unsigned row = 0; row < height; row++) {
+        for (unsigned col = 0; col < width; col++) {
+            CellType type = cell(row, col).type;
+            Tile &t = tile(row, col);
+            if (type & SmokeCells) {
+                smoke_count++;
+                t.smoke++;
+            }
+            if (type & smokeable) {
+                t.smokeable++;
+            }
+            if (type & (Person | PersonWithSmoke | PersonAtExit)) {
+                t.agents++;
+            }
+            if ((type & WalkableCells) && !reachable.empty() &&
+                !reachable[cell_index(row, col)])
+            {
+                t.unreachable++;
+            }
+        }
+    }
+    select_kernels();
+}
+
+template<bool SmokeSpreading>
+bool CA::tile_active(size_t t) const {
+    if (tiles[t].agents > 0) {
+        return true;
+    }
+    if (!SmokeSpreading || tiles[t].smoke == tiles[t].smokeable) {
+        return false;
+    }
+
+    // Smoke may spread in from adjacent tiles
+    size_t tile_row = t / tiles_wide, tile_col = t % tiles_wide;
+    size_t tiles_high = tiles.size() / tiles_wide;
+    for (size_t r = tile_row ? tile_row - 1 : 0;
+        r <= tile_row + 1 && r < tiles_high; r++)
+    {
+        for (size_t c = tile_col ? tile_col - 1 : 0;
+            c <= tile_col + 1 && c < tiles_wide; c++)
+        {
+            if (tiles[r * tiles_wide + c].smoke > 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void CA::seed(uint64_t seed) {
+    rng.seed(seed);
+}
+
+void CA::checkpoint(const std::string &filename) const {
+    Checkpoint::store(*this, filename);
+}
+
+CA CA::restore(const std::string &filename) {
+    return Checkpoint::load(filename);
+}
+
+void CA::save(const std::string &filename) {
+    MapFile::store(*this, filename);
+}
+
 void CA::show() {
     Bitmap::store(*this, "output.bmp");
 }
 
 
-std::string Statistics::str() const noexcept {
+constexpr size_t ModelParams::count;
+
+const char *ModelParams::names[ModelParams::count] = {
+    "time_step", "cell_width", "chaos_rate", "smoke_spreading_rate",
+    "occupied_distance", "smoke_distance", "friction"
+};
+
+/// Parameters in order of ModelParams::names.
+static float ModelParams::* const param_members[ModelParams::count] = {
+    &ModelParams::time_step, &ModelParams::cell_width,
+    &ModelParams::chaos_rate, &ModelParams::smoke_spreading_rate,
+    &ModelParams::occupied_distance, &ModelParams::smoke_distance,
+    &ModelParams::friction
+};
+
+float &ModelParams::at(size_t index) {
+    return this->*param_members[index];
+}
+
+float ModelParams::at(size_t index) const {
+    return this->*param_members[index];
+}
+
+size_t ModelParams::index(const std::string &name) {
+    for (size_t i = 0; i < count; i++) {
+        if (name == names[i]) {
+            return i;
+        }
+    }
+    throw std::invalid_argument("unknown parameter " + name);
+}
+
+void ModelParams::set(const std::string &assignment) {
+    size_t eq = assignment.find('=');
+    if (eq == std::string::npos) {
+        throw std::invalid_argument("expected parameter=value");
+    }
+    std::istringstream in(assignment.substr(0, eq));
+    std::string name;
+    in >> name;
+    float value;
+    std::istringstream vin(assignment.substr(eq + 1));
+    if (!(vin >> value)) {
+        throw std::invalid_argument("invalid value of parameter " + name);
+    }
+    at(index(name)) = value;
+}
+
+void ModelParams::load(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in) {
+        throw std::invalid_argument("could not open configuration file");
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") != std::string::npos) {
+            set(line);
+        }
+    }
+}
+
+const char *Statistics::metric_names[Statistics::Metrics] = {
+    "time", "smoke", "moves", "evac", "max_smoke"
+};
+
+double Statistics::value(Metric metric) const {
+    switch (metric) {
+        case Time:
+            return time;
+        case SmokeExposed:
+            return smoke_exposed;
+        case Moves:
+            return moves;
+        case EvacTime:
+            return evac_time;
+        case MaxSmokeExposed:
+            return max_smoke_exposed;
+        default:
+            return 0.0;
+    }
+}
+
+Statistics::Metric Statistics::metric(const std::string &name) {
+    for (int m = 0; m < Metrics; m++) {
+        if (name == metric_names[m]) {
+            return (Metric) m;
+        }
+    }
+    throw std::invalid_argument("unknown metric " + name);
+}
+
+/** Print mean and confidence interval of an accumulator. */
+static void interval(std::ostream &ss, const Accumulator &acc, double scale) {
+    ss << acc.mean() * scale << " +- ";
+    if (std::isnan(acc.ci())) {
+        ss << "n/a";
+    }
+    else {
+        ss << acc.ci() * scale;
+    }
+}
+
+/** Print p50/p95/p99 of an accumulator. */
+static void percentiles(
+    std::ostream &ss, const Accumulator &acc, double scale
+) {
+    ss << acc.quantile(0.50) * scale << " / "
+        << acc.quantile(0.95) * scale << " / "
+        << acc.quantile(0.99) * scale;
+}
+
+std::string Statistics::str(const ModelParams &params) const noexcept {
 	std::ostringstream ss;
     ss << "*********************************************************\n";
-    float travelled = moves * cell_width;
-    float realtime = time * time_step;
+    double per_person = pedestrians > 0 ? 1.0 / pedestrians : 0.0;
     ss << "Number of pedestrians              : " << pedestrians
         << std::endl;
-    ss << "Total evacuation time              : " << realtime << " s"
+    ss << "Number of runs                     : " << runs()
         << std::endl;
-    ss << "Mean time per person in smoke      : "
-        << smoke_exposed * time_step / pedestrians << " s" << std::endl;
-    ss << "Max time in smoke                  : "
-        << max_smoke_exposed * time_step << " s" << std::endl;
-    ss << "Mean evacuation time per person    : "
-        << evac_time * time_step / pedestrians << " s" << std::endl;
-    ss << "Total distance travelled           : " << travelled << " m"
+    ss << "Intervals (+-)                     : 95 % confidence of the mean"
         << std::endl;
-    ss << "Mean distance travelled per person : "
-        << travelled / pedestrians << " m" << std::endl;
+    ss << "Total evacuation time              : ";
+    interval(ss, metrics[Time], params.time_step);
+    ss << " s" << std::endl;
+    ss << "  p50 / p95 / p99                  : ";
+    percentiles(ss, metrics[Time], params.time_step);
+    ss << " s" << std::endl;
+    ss << "Mean time per person in smoke      : ";
+    interval(ss, metrics[SmokeExposed], params.time_step * per_person);
+    ss << " s" << std::endl;
+    ss << "Max time in smoke                  : ";
+    interval(ss, metrics[MaxSmokeExposed], params.time_step);
+    ss << " s (overall " << metrics[MaxSmokeExposed].max() * params.time_step
+        << " s)" << std::endl;
+    ss << "Mean evacuation time per person    : ";
+    interval(ss, metrics[EvacTime], params.time_step * per_person);
+    ss << " s" << std::endl;
+    ss << "  p50 / p95 / p99 per person       : ";
+    percentiles(ss, person_evac, params.time_step);
+    ss << " s" << std::endl;
+    ss << "Total distance travelled           : ";
+    interval(ss, metrics[Moves], params.cell_width);
+    ss << " m" << std::endl;
+    ss << "Mean distance travelled per person : ";
+    interval(ss, metrics[Moves], params.cell_width * per_person);
+    ss << " m" << std::endl;
+    if (stranded > 0) {
+        ss << "Stranded people                    : " << stranded
+            << " in " << stranded_runs << " runs" << std::endl;
+    }
     ss << "*********************************************************\n";
 
     return ss.str();
 }
 
 void Statistics::aggregate(Statistics &other) {
+	stranded += other.stranded;
+	stranded_runs += other.stranded > 0;
+	time += other.time;
+	smoke_exposed += other.smoke_exposed;
+	moves += other.moves;
+	evac_time += other.evac_time;
+	max_smoke_exposed = std::max(max_smoke_exposed, other.max_smoke_exposed);
+	for (int m = 0; m < Metrics; m++) {
+	    metrics[m].push(other.value((Metric) m));
+	}
+	person_evac.merge(other.person_evac);
+}
+
+void Statistics::merge(const Statistics &other) {
+	stranded += other.stranded;
+	stranded_runs += other.stranded_runs;
 	time += other.time;
 	smoke_exposed += other.smoke_exposed;
 	moves += other.moves;
 	evac_time += other.evac_time;
-	max_smoke_exposed += other.max_smoke_exposed;
+	max_smoke_exposed = std::max(max_smoke_exposed, other.max_smoke_exposed);
+	for (int m = 0; m < Metrics; m++) {
+	    metrics[m].merge(other.metrics[m]);
+	}
+	person_evac.merge(other.person_evac);
 }
 
 void Statistics::normalize(unsigned runs) {
@@ -422,5 +1728,4 @@ void Statistics::normalize(unsigned runs) {
 	smoke_exposed /= runs;
 	moves /= runs;
 	evac_time /= runs;
-    max_smoke_exposed /= runs;
 }
@@ -8,30 +8,76 @@
 
 #include <vector>
 #include <list>
+#include <string>
 #include <iostream>
 #include <climits>
 #include <cassert>
+#include <memory>
+#include <atomic>
+
+#include "random.h"
+#include "accumulator.h"
+#include "placement.h"
+#include "arena.h"
 
 namespace Evacuation {
 
 // Simulation parameters:
 
-/// Real seconds per simulation step
-const float time_step = 0.3;
-/// Width of a cell in meters
-const float cell_width = 0.4;
-/// Probability that person moves to cell with same exit distance
-const float chaos_rate = 0.25;
-/// Coefficient of smoke spreading.
-const float smoke_spreading_rate = 0.2;
-/// Occupied cell distance factor (1.0 => usual distance)
-const float occupied_distance = 2.0;
-/// Effect of smoke on exit distance (1.0 => usual distance)
-const float smoke_distance = 5.0;
+/** Model parameters; the defaults are the calibrated values. */
+struct ModelParams {
+    /// Real seconds per simulation step
+    float time_step = 0.3;
+    /// Width of a cell in meters
+    float cell_width = 0.4;
+    /// Probability that person moves to cell with same exit distance
+    float chaos_rate = 0.25;
+    /// Coefficient of smoke spreading.
+    float smoke_spreading_rate = 0.2;
+    /// Occupied cell distance factor (1.0 => usual distance)
+    float occupied_distance = 2.0;
+    /// Effect of smoke on exit distance (1.0 => usual distance)
+    float smoke_distance = 5.0;
+    /// Probability that nobody enters a cell claimed by several people
+    /// (parallel update only)
+    float friction = 0.3;
+
+    /// Number of parameters
+    static constexpr size_t count = 7;
+    /// Names of parameters (in order of declaration)
+    static const char *names[count];
+
+    /** @return parameter with the specified index */
+    float &at(size_t index);
+    float at(size_t index) const;
+
+    /**
+     * @param name name of a parameter
+     * @return index of the parameter
+     * @throw invalid_argument if there is no such parameter
+     */
+    static size_t index(const std::string &name);
+
+    /**
+     * Set a parameter from a "name=value" assignment.
+     * @throw invalid_argument if the assignment is malformed
+     */
+    void set(const std::string &assignment);
+
+    /**
+     * Set parameters from a configuration file of "name = value" lines
+     * ('#' starts a comment).
+     * @throw invalid_argument if failed to process the file
+     */
+    void load(const std::string &filename);
+};
 
 /// Position in matrix.
 using CellPosition = std::pair<size_t, size_t>;
 
+/// Positions of people collected by a step (from the step arena).
+using People = ArenaVector<CellPosition>;
+
 /** Type of a cell. */
 enum CellType {
     Empty =             0b0000000001,
@@ -46,19 +92,84 @@ enum CellType {
     ObstacleWithSmoke = 0b1000000000
 };
 
+/// Number of cell types (bits of CellType).
+constexpr unsigned CellTypes = 10;
+
+/**
+ * @return true if a stored value is a single CellType bit; solvers index
+ * tables by the bit number, so files must hold nothing else
+ */
+constexpr bool valid_cell_type(unsigned value) {
+    return value != 0 && (value & (value - 1)) == 0 &&
+        value < (1u << CellTypes);
+}
+
 // Groups of cell types used for cell filtering
 
 /// Cells where person can move into.
 constexpr int EmptyCells = Empty | Smoke | PersonAppearance | Exit;
 /// Cells which have an impact of smoke propagation.
 constexpr int SmokeCells = Smoke | ObstacleWithSmoke | PersonWithSmoke;
+/// Cells considered reachable by exit distance solvers.
+constexpr int WalkableCells = Empty | Exit | Person | Smoke
+    | PersonAppearance | PersonAtExit | PersonWithSmoke;
+
+/** Exit distance solvers. */
+enum Solver {
+    /// Exact Dijkstra over all cells
+    DijkstraSolver,
+    /// Two-level search over the tile graph, see TileGraph
+    HierarchicalSolver,
+    /// Exact Dijkstra keeping the nearest exits of each cell, see
+    /// CA::nearest_exits()
+    MultiExitSolver,
+    /// Exact Dijkstra over the walkable cells only, see CellGraph
+    CompactSolver
+};
+
+/** Pedestrian update rules. */
+enum Update {
+    /// People move one at a time in random order
+    SequentialUpdate,
+    /// People pick their moves from the same state, see CA::set_update()
+    ParallelUpdate,
+    /// People claim cells concurrently, see CA::set_update()
+    ReservationUpdate,
+    /// People move one at a time in a blockwise random order, see
+    /// CA::set_update()
+    LocalUpdate
+};
+
+/** Smoke spreading modes. */
+enum SmokeSpread {
+    /// Smoke spreads during the scan of each step
+    InlineSmoke,
+    /// Smoke arrivals are computed when a step needs them, see SmokePlane
+    LazySmoke,
+    /// Smoke arrivals are computed ahead by a thread, see SmokePlane
+    AheadSmoke
+};
+
+class TileGraph;
+class CellGraph;
+class SmokePlane;
+class ThreadPool;
 
 /**
  * Simulation (aggregated) statistics.
- * Some values were converted to floating point for aggregation.
+ * The counters describe a single run; distributions of the per-run
+ * values are accumulated by aggregate() and merged by merge().
  */
 class Statistics {
 public:
+    /** Aggregated per-run metrics. */
+    enum Metric {
+        Time, SmokeExposed, Moves, EvacTime, MaxSmokeExposed, Metrics
+    };
+
+    /** Names of aggregated metrics. */
+    static const char *metric_names[Metrics];
+
 	/** Initial number of pedestrians. */
     int pedestrians;
     /** Extraction time (steps). */
@@ -71,20 +182,83 @@ public:
     double evac_time;
     /** Max person smoke expose*/
     double max_smoke_exposed;
+    /** People left that could not reach an exit (see CA::evolve()). */
+    int stranded;
+    /** Aggregated runs that left stranded people. */
+    unsigned stranded_runs;
+    /** Distribution of per-person evacuation times (steps). */
+    Accumulator person_evac;
+    /** Distributions of aggregated per-run metrics. */
+    Accumulator metrics[Metrics];
 
 	Statistics() :
 		pedestrians{0}, time{0.0}, smoke_exposed{0.0},
-		moves{0.0}, evac_time{0.0}, max_smoke_exposed{0.0}
+		moves{0.0}, evac_time{0.0}, max_smoke_exposed{0.0},
+		stranded{0}, stranded_runs{0}
     {}
 
     /** String representation of statistics. */
-    std::string str() const noexcept;
+    std::string str(const ModelParams &params = ModelParams()) const noexcept;
 
-    /** Aggregate statistics. */
+    /** Aggregate statistics of a single run. */
     void aggregate(Statistics &other);
 
+    /** Merge statistics aggregated elsewhere (e.g. in other thread). */
+    void merge(const Statistics &other);
+
     /** Normalize statistics for final output. */
     void normalize(unsigned runs);
+
+    /** @return number of aggregated runs */
+    unsigned runs() const { return metrics[Time].count(); }
+
+    /** @return value of a metric of a single run */
+    double value(Metric metric) const;
+
+    /**
+     * @param name name of a metric, see metric_names
+     * @return metric with the specified name
+     * @throw invalid_argument if there is no such metric
+     */
+    static Metric metric(const std::string &name);
+};
+
+/** Activity counters of a square block of cells. */
+struct Tile {
+    /** Cells with people (including people at exits). */
+    unsigned agents;
+    /** Cells of SmokeCells types. */
+    unsigned smoke;
+    /** Cells that are or may become smoke. */
+    unsigned smokeable;
+    /** Walkable cells no exit can be reached from. */
+    unsigned unreachable;
+    /** Accruals changed since the hierarchical solver last saw the tile. */
+    bool dirty;
+
+    Tile() :
+        agents{0}, smoke{0}, smokeable{0}, unreachable{0}, dirty{true}
+    {}
+};
+
+/** Walkable regions no exit can be reached from. */
+struct Unreachable {
+    /** 8-connected regions of walkable cells without an exit. */
+    unsigned regions = 0;
+    /** Cells of the regions. */
+    size_t cells = 0;
+    /** PersonAppearance cells of the regions. */
+    size_t spawns = 0;
+    /** People standing in the regions. */
+    size_t people = 0;
+};
+
+/** Exit reachable from a cell. */
+struct ExitLabel {
+    /** Index of the exit (UINT_MAX = none). */
+    unsigned exit;
+    /** Distance (in pseudo-hops) to the exit. */
+    unsigned distance;
 };
 
 /** Cell structure. */
@@ -106,6 +280,12 @@ struct Cell {
  * The state space is assumed to be 2-dimensional and constant.
  */
 class CA {
+    friend class MapFile;
+    friend class Checkpoint;
+    friend class TileGraph;
+    friend class CellGraph;
+    friend class Wavefront;
+    friend class Domain;
 public:
     /// Number of rows
     unsigned height;
@@ -119,18 +299,33 @@ public:
 
     /**
      * Apply transition function on CA states.
+     * People in regions without an exit are stranded: they neither move
+     * nor count as targets of the exit distance solvers. The run ends
+     * once only stranded people are left, or after stall_steps steps
+     * without progress (the watchdog, which ends jams friction never
+     * resolves, see stall()); the people left are recorded in
+     * Statistics::stranded.
+     * Temporaries of the step come from an arena reset at the end of
+     * each step, and the evacuation time histogram is sized ahead of
+     * the step counter, so steps in steady state do not allocate. With
+     * the lazy and ahead smoke modes, the first step takes the smoke
+     * plane.
      * @return false if there are no people to evacuate, true otherwise
      */
     bool evolve();
 
-    /** Distribute people over the building. */
+    /**
+     * Distribute people over the building; cells no exit can be reached
+     * from are left empty.
+     * @throw logic_error if there are fewer reachable empty cells
+     */
     void add_people(int people);
 
     /** Distribute smoke over the building. */
     void add_smoke(int smoke);
 
     /**
-     * Load model description from a bitmap.
+     * Load model description from a bitmap or a native map.
      * @param filename name of input file
      * @return instance of CA class
      * @throw invalid_argument if failed to process input file
@@ -138,24 +333,259 @@ public:
      */
     static CA load(const std::string &filename);
 
+    /**
+     * Store model description as a native map.
+     * @param filename name of output file
+     * @throw runtime_error if failed to write output file
+     */
+    void save(const std::string &filename);
+
     /** Store model description to "output.bmp". */
     void show();
 
     /** Copy the CA. */
-    CA copy();
+    CA copy() const;
+
+    /**
+     * Set model parameters.
+     * Selects evolution and solver kernels specialised for the common
+     * cases (no smoke, no chaos, integral accruals).
+     */
+    void set_params(const ModelParams &params);
+
+    /** @return model parameters */
+    const ModelParams &params() const {
+        return parameters;
+    }
+
+    /** Select the exit distance solver. */
+    void set_solver(Solver solver);
+
+    /**
+     * Select the pedestrian update rule.
+     * With the parallel update, every person picks a move from the state
+     * left by the previous step; when several people pick the same cell,
+     * nobody enters it with probability ModelParams::friction, otherwise
+     * one of them, picked uniformly, does. Moves are picked by chunks of
+     * people with independent random streams, so results do not depend
+     * on the number of threads.
+     * With the reservation update, people in random order claim their
+     * best neighbour with an atomic compare-and-swap on the reservation
+     * plane; losers try their next best neighbours, then stay. Threads
+     * claim and move concurrently, so with several threads the winners
+     * depend on scheduling.
+     * The local update is the sequential update in a cheaper random
+     * order: people are collected tile by tile, so nearby people are
+     * adjacent in the list. The list is cut into blocks of
+     * order_block people, and the blocks are visited in random order,
+     * each shuffled on its own. Every person still moves once per step,
+     * one at a time. Each block touches only a few tiles, but the order
+     * is not a uniform permutation.
+     * With several threads, the i-th worker takes the i-th band of the
+     * chunks of people, which are collected tile by tile, and first
+     * touches the i-th band of the cell and reservation planes (see
+     * Placement::spread()). Models set up by the same thread share its
+     * pool of that many workers, so replicates do not start threads.
+     * @param threads number of threads picking (and making) moves
+     */
+    void set_update(Update update, unsigned threads = 1);
+
+    /**
+     * Select the smoke spreading mode.
+     * Smoke does not depend on the people, so the lazy and ahead modes
+     * simulate it apart, with a random stream of its own (see
+     * SmokePlane), and the steps only turn the cells it reaches into
+     * smoke. Runs differ from the inline mode, which shares the random
+     * stream of the people.
+     */
+    void set_smoke(SmokeSpread spread);
+
+    /// Number of nearest exits kept per cell by the multi-exit solver.
+    static constexpr unsigned exit_labels = 2;
+
+    /// Steps without progress after which a run ends, see stall().
+    static constexpr unsigned stall_steps = 1000;
+
+    /** @return walkable regions no exit can be reached from */
+    const Unreachable &unreachable() const {
+        return unreachable_regions;
+    }
+
+    /**
+     * @return number of exits (8-connected groups of exit cells, indexed
+     * in row-major order of their first cells), including blocked ones
+     */
+    unsigned exit_count() const {
+        return exits.size();
+    }
+
+    /**
+     * @return exit_labels nearest open exits of a cell ordered by
+     * distance, or nullptr unless the multi-exit solver is selected
+     */
+    const ExitLabel *nearest_exits(unsigned row, unsigned col) const;
+
+    /**
+     * Block an exit: its cells become walls and people standing in it
+     * leave the building. With the multi-exit solver, cells heading to
+     * the exit fall back to their next nearest exit without a new solve.
+     * Cells whose fallback may run through the walled cells (it is not
+     * shorter than their distance to the walled exit plus the shortest
+     * way on from it) are solved again from the cells around them, so
+     * the field stays exact.
+     * @param exit index of the exit
+     * @throw invalid_argument if there is no such exit
+     * @throw logic_error if the exit is the last open one
+     */
+    void disable_exit(unsigned exit);
+
+    /** Reseed the random number generator of the CA. */
+    void seed(uint64_t seed);
+
+    /**
+     * Store a snapshot of the running CA, see Checkpoint.
+     * @param filename name of output file
+     * @throw runtime_error if failed to write output file
+     * @throw logic_error if smoke does not spread inline
+     */
+    void checkpoint(const std::string &filename) const;
+
+    /**
+     * Restore a CA from a snapshot, see Checkpoint.
+     * @param filename name of input file
+     * @return instance of CA class
+     * @throw invalid_argument if failed to process input file
+     */
+    static CA restore(const std::string &filename);
 
     // Inline methods:
 
     /** Retrieve a cell at a specified position. */
     inline Cell& cell(int row, int col) {
-        return cells[row][col];
+        return cells[cell_index(row, col)];
+    }
+
+    inline const Cell& cell(int row, int col) const {
+        return cells[cell_index(row, col)];
     }
 
 private:
-    /// 2D matrix of cells.
-    std::vector<std::vector<Cell>> cells;
+    /// Tile edge is 2^tile_bits cells.
+    static constexpr unsigned tile_bits = 4;
+    static constexpr unsigned tile_size = 1 << tile_bits;
+
+    /// Cells tile by tile in the order of tiles, row-major within a tile;
+    /// tiles crossing the right or bottom edge are padded with walls
+    Plane<Cell> cells;
+    /// Number of tile columns
+    unsigned tiles_wide;
+    /// Row-major matrix of tiles covering the cells
+    std::vector<Tile> tiles;
     /// Precomuted vector of exit states
     std::vector<CellPosition> exit_states;
+    /// Cells of each exit (empty once blocked)
+    std::vector<std::vector<CellPosition>> exits;
+    /// Row-major nearest exits of cells (exit_labels per cell), kept by
+    /// the multi-exit solver
+    Plane<ExitLabel> labels;
+    /// Walkable cells an exit can be reached from by cell index (empty
+    /// until the regions are labelled), see label_regions()
+    Plane<uint8_t> reachable;
+    /// Regions no exit can be reached from
+    Unreachable unreachable_regions;
+    /// Steps without progress, see stall()
+    unsigned stalled;
+    /// Lowest total exit distance of the people since the last
+    /// evacuation or change of the field, see stall()
+    double closest;
+    /// Total exit distance of the people the step moves (stranded
+    /// people left out)
+    double remaining;
+    /// Random number generator
+    Random rng;
+    /// Model parameters
+    ModelParams parameters;
+    /// Number of cells of SmokeCells types
+    size_t smoke_count;
+
+    // Exit distance solver workspace, kept between solves
+
+    /// Heap entry (distance, cell index)
+    using HeapEntry = std::pair<double, uint32_t>;
+    /// Solve counter; stamps older than the current solve read as unset
+    uint32_t epoch;
+    /// Stamps by cell index: 2 * epoch once reached, 2 * epoch + 1 once
+    /// settled
+    Plane<uint32_t> solve_state;
+    /// Stamps by cell index: epoch if the targets read the cell
+    Plane<uint32_t> solve_needed;
+    /// Tentative distances by cell index of solves with fractional
+    /// accruals
+    Plane<double> solve_distance;
+    /// Binary min-heap of reached cells (room for a cell each, so
+    /// steady-state solves do not allocate)
+    std::vector<HeapEntry> solve_heap;
+
+    /** Tentative label of the multi-exit solver. */
+    struct LabelEntry {
+        /// Distance to the exit
+        double distance;
+        /// Row-major cell index
+        uint32_t cell;
+        /// Index of the exit
+        uint32_t exit;
+    };
+    /// Multi-exit solve counter; stamps older than the current solve
+    /// read as unset
+    uint32_t label_epoch;
+    /// Stamps by row-major cell: label_epoch once the cell settled a label
+    Plane<uint32_t> label_stamp;
+    /// Labels settled by row-major cell (cells stamped by the solve only)
+    Plane<uint8_t> label_count;
+    /// Stamps by row-major cell: label_epoch if the targets read the cell
+    Plane<uint32_t> label_needed;
+    /// Binary min-heap of tentative labels, kept between solves
+    std::vector<LabelEntry> label_heap;
+
+    /// Best moves of people by cell index, emitted by the Dijkstra solver:
+    /// exit distance of the best neighbours << 8 | lanes (see next_move())
+    /// of the neighbours at that distance
+    Plane<uint32_t> best_moves;
+    /// Best moves match the exit field (otherwise moves are scanned)
+    bool moves_current;
+    /// Evolution kernel specialised for the parameters
+    bool (CA::*evolve_kernel)();
+    /// Exit distance solver specialised for the parameters
+    void (CA::*solve_kernel)(const People *);
+    /// Selected exit distance solver
+    Solver solver;
+    /// Tile graph of the hierarchical solver
+    std::shared_ptr<TileGraph> graph;
+    /// Walkable-cell graph of the compact solver
+    std::shared_ptr<CellGraph> compact;
+    /// Selected pedestrian update rule
+    Update update;
+    /// Threads picking moves of the parallel and reservation updates
+    unsigned update_threads;
+    /// Workers of the parallel and reservation updates, shared by the
+    /// models of a thread (nullptr = single thread)
+    std::shared_ptr<ThreadPool> pool;
+    /// Row-major generation of the last claim of each cell
+    std::shared_ptr<Plane<std::atomic<uint32_t>>> reservations;
+    /// Generation of claims of the current step
+    uint32_t generation;
+    /// Temporaries of the current step, released when the next starts
+    std::shared_ptr<Arena> arena;
+    /// Selected smoke spreading mode
+    SmokeSpread smoke_spread;
+    /// Smoke arrivals of the lazy and ahead modes, taken at the first
+    /// step after the cells were (re)counted
+    std::shared_ptr<SmokePlane> smoke_plane;
+
+    /// People whose moves share a random stream in the parallel update
+    static constexpr size_t update_chunk = 256;
+    /// People shuffled together in the local update
+    static constexpr size_t order_block = 64;
 
     // methods
 
@@ -170,8 +600,156 @@ private:
         size_t row, size_t col, int cell_types = EmptyCells
     ) const;
 
-    /** Recompute exit distances. */
-    void recompute_shortest_paths();
+    /** @return number of Moore neighbours of specified types */
+    unsigned count_neighbours(size_t row, size_t col, int cell_types) const;
+
+    /**
+     * Pick the neighbour a person moves towards: an EmptyCells neighbour
+     * with the minimum exit distance, ties broken uniformly. The best
+     * moves emitted by the solver are used while one of them can still
+     * be entered; otherwise the neighbourhood is scanned.
+     * @param next picked neighbour
+     * @param random random number generator breaking ties
+     * @return false if the person has no neighbour to move into
+     */
+    bool next_move(CellPosition person, CellPosition &next, Random &random);
+
+    /**
+     * Rank the neighbours a person may move into.
+     * @param ranked neighbours by exit distance, ties in uniform order
+     * (room for 8)
+     * @return number of ranked neighbours
+     */
+    unsigned rank_moves(
+        CellPosition person, CellPosition *ranked, Random &random) const;
+
+    /** Blockwise random order of people of the local update. */
+    void order_blocks(People &people);
+
+    /** Move a person to a neighbouring cell. */
+    void move(CellPosition person, CellPosition next);
+
+    /**
+     * Move a person's cell state only; touches no cell but the two.
+     * @see account()
+     */
+    void relocate(CellPosition person, CellPosition next);
+
+    /** Update statistics and tile counters of a relocated person. */
+    void account(CellPosition person, CellPosition next);
+
+    /**
+     * Run a phase of the parallel or reservation update over chunks of
+     * update_chunk people, on the pool if there is one.
+     * @param phase callable taking the index of a chunk
+     */
+    template<typename Phase>
+    void run_chunks(size_t people, const Phase &phase);
+
+    /**
+     * Parallel update of people.
+     * @tparam Chaos people may move sideways (non-zero chaos rate)
+     */
+    template<bool Chaos>
+    void move_parallel(const People &people);
+
+    /**
+     * Reservation update of people.
+     * @tparam Chaos people may move sideways (non-zero chaos rate)
+     */
+    template<bool Chaos>
+    void move_reserved(People &people);
+
+    /**
+     * Recompute exit distances.
+     * @param targets people whose moves read the distances; the search
+     * stops once they and their neighbours are settled, other cells may
+     * be left with stale or infinite distances (nullptr = whole field)
+     * @note the whole field of a building without people and smoke is a
+     * breadth-first search, see Wavefront
+     */
+    void recompute_shortest_paths(
+        const People *targets = nullptr);
+
+    /** Group exit states into exits. */
+    void group_exits();
+
+    /**
+     * Label the 8-connected regions of walkable cells and mark the cells
+     * of regions with an exit as reachable. People in the other regions
+     * can never leave, so spawning skips them, the solvers never search
+     * them and their people are stranded.
+     */
+    void label_regions();
+
+    /** Remove a person standing at an exit. */
+    void evacuate(Cell &cell, Tile &tile);
+
+    /**
+     * Advance the watchdog by a step. The step makes progress if
+     * somebody evacuates or the people get closer to the exits than
+     * ever since the last evacuation: people shuffling in a jam do not.
+     * Spreading smoke and blocked exits lengthen distances, so the
+     * record restarts.
+     * @param remaining total exit distance of the people not stranded
+     * @param evacuated somebody evacuated at the step
+     * @param lengthened the field lengthened at the step
+     * @return true after stall_steps steps without progress
+     */
+    bool stall(double remaining, bool evacuated, bool lengthened);
+
+    /**
+     * Select kernels specialised for the current parameters and for
+     * the presence of smoke.
+     */
+    void select_kernels();
+
+    /**
+     * Recount smoke cells and tile counters (after bulk changes) and
+     * reselect kernels.
+     */
+    void recount();
+
+    /**
+     * @return true if the tile has to be scanned: it contains people,
+     * or smoke may spread into it
+     */
+    template<bool SmokeSpreading>
+    bool tile_active(size_t t) const;
+
+    /**
+     * Evolution kernel.
+     * @tparam SmokeSpreading smoke may spread (non-zero spreading rate)
+     * @tparam Chaos people may move sideways (non-zero chaos rate)
+     */
+    template<bool SmokeSpreading, bool Chaos>
+    bool evolve_step();
+
+    /**
+     * Exit distance solver.
+     * @tparam Distance unsigned for integral accruals, double otherwise
+     * @tparam SmokePresent smoke cells exist (smoke accruals apply)
+     */
+    template<typename Distance, bool SmokePresent>
+    void solve(const People *targets);
+
+    /**
+     * Multi-exit solver: a single Dijkstra pass over (cell, exit) labels
+     * settling up to exit_labels distinct exits per cell. Like solve(),
+     * it stops once the cells around the targets are settled and only
+     * rewrites the labels of the cells it settles.
+     * @tparam Distance unsigned for integral accruals, double otherwise
+     * @tparam SmokePresent smoke cells exist (smoke accruals apply)
+     */
+    template<typename Distance, bool SmokePresent>
+    void solve_exits(const People *targets);
+
+    /** Hierarchical exit distance solver, see TileGraph. */
+    void solve_hierarchical(const People *targets);
+
+    /** Compact exit distance solver, see CellGraph. */
+    template<typename Distance, bool SmokePresent>
+    void solve_compact(const People *targets);
 
     // Inline methods:
 
@@ -191,7 +769,7 @@ private:
         std::vector<CellPosition> &vec, size_t row, size_t col,
         int cell_types) const
     {
-        if (cell_check(row, col) && (cells[row][col].type & cell_types)) {
+        if (cell_check(row, col) && (cell(row, col).type & cell_types)) {
             vec.push_back(CellPosition(row, col));
         }
     }
@@ -203,13 +781,72 @@ private:
 
     /** @return a distance to exit from cell at specified position */
     inline int distance(size_t row, size_t col) const {
-        return cells[row][col].exit_distance;
+        return cell(row, col).exit_distance;
     }
 
     /** Retrieve a cell at a specified position. */
     inline Cell& cell(CellPosition pos) {
         return cell(pos.first, pos.second);
     }
+
+    /** @return tentative distance of a stored cell in an integral solve */
+    inline unsigned &tentative(size_t index, unsigned) {
+        return cells[index].exit_distance;
+    }
+
+    /** @return tentative distance of a stored cell in a fractional solve */
+    inline double &tentative(size_t index, double) {
+        return solve_distance[index];
+    }
+
+    /** @return distance accrual of a cell of the specified type */
+    inline double accrual(CellType type) const {
+        double accrual = 1.0;
+        if (type & (Person | PersonWithSmoke)) {
+            accrual *= parameters.occupied_distance;
+        }
+        if (type & (Smoke | PersonWithSmoke)) {
+            accrual *= parameters.smoke_distance;
+        }
+        return accrual;
+    }
+
+    /** @return index of the tile containing a cell */
+    inline size_t tile_index(size_t row, size_t col) const {
+        return (row >> tile_bits) * tiles_wide + (col >> tile_bits);
+    }
+
+    /** @return index of a cell in the cell storage */
+    inline size_t cell_index(size_t row, size_t col) const {
+        return tile_index(row, col) << (2 * tile_bits)
+            | (row & (tile_size - 1)) << tile_bits | (col & (tile_size - 1));
+    }
+
+    inline size_t cell_index(CellPosition pos) const {
+        return cell_index(pos.first, pos.second);
+    }
+
+    /** @return position of the cell stored at an index */
+    inline CellPosition cell_position(size_t index) const {
+        size_t t = index >> (2 * tile_bits);
+        return CellPosition(
+            (t / tiles_wide) << tile_bits
+                | (index >> tile_bits & (tile_size - 1)),
+            (t % tiles_wide) << tile_bits | (index & (tile_size - 1)));
+    }
+
+    inline size_t tile_index(CellPosition pos) const {
+        return tile_index(pos.first, pos.second);
+    }
+
+    /** Retrieve the tile containing a cell. */
+    inline Tile& tile(size_t row, size_t col) {
+        return tiles[tile_index(row, col)];
+    }
+
+    inline Tile& tile(CellPosition pos) {
+        return tile(pos.first, pos.second);
+    }
 };
 
 } // end of namespace
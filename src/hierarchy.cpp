@@ -0,0 +1,314 @@
+/**
+ * @file hierarchy.cpp
+ * Hierarchical (tile graph) exit distance solver implementation.
+ */
+
+#include <queue>
+#include <limits>
+#include <algorithm>
+#include <functional>
+
+#include "hierarchy.h"
+
+using namespace Evacuation;
+
+/// Unreachable distance.
+static constexpr double infinity = std::numeric_limits<double>::infinity();
+
+/// Maximum length of entrance served by a single portal pair.
+static constexpr unsigned portal_spacing = 4;
+
+/**
+ * @return positions of portals along an entrance [from, to): middles of
+ * equal segments no longer than portal_spacing
+ */
+static std::vector<unsigned> spread(unsigned from, unsigned to) {
+    std::vector<unsigned> res;
+    if (to <= from) {
+        return res;
+    }
+    unsigned length = to - from;
+    unsigned n = (length + portal_spacing - 1) / portal_spacing;
+    for (unsigned i = 0; i < n; i++) {
+        res.push_back(from + (2 * i + 1) * length / (2 * n));
+    }
+    return res;
+}
+
+/// Heap entry (distance, index).
+using Entry = std::pair<double, unsigned>;
+/// Min-heap of entries (from the step arena).
+using Heap =
+    std::priority_queue<Entry, ArenaVector<Entry>, std::greater<Entry>>;
+
+/** @return empty heap allocating from an arena */
+static Heap arena_heap(Arena &arena) {
+    return Heap(std::greater<Entry>(),
+        ArenaVector<Entry>{ArenaAllocator<Entry>(arena)});
+}
+
+TileGraph::TileGraph(const CA &ca) {
+    const unsigned size = CA::tile_size;
+    unsigned tiles_wide = ca.tiles_wide;
+    unsigned tiles_high = ca.tiles.size() / tiles_wide;
+
+    auto walkable = [&ca](unsigned row, unsigned col) {
+        return (ca.cell(row, col).type & WalkableCells) != 0;
+    };
+
+    Layout *l = new Layout;
+    l->tile_portals.resize(ca.tiles.size());
+    l->tile_exits.resize(ca.tiles.size());
+    for (auto &es : ca.exit_states) {
+        l->tile_exits[ca.tile_index(es)].push_back(es);
+    }
+
+    // Adds a linked pair of portals
+    auto link = [&](unsigned ra, unsigned cola, unsigned rb, unsigned colb) {
+        unsigned a = l->portals.size();
+        for (int side = 0; side < 2; side++) {
+            Portal p;
+            p.row = side ? rb : ra;
+            p.col = side ? colb : cola;
+            p.tile = ca.tile_index(p.row, p.col);
+            p.local = l->tile_portals[p.tile].size();
+            p.partner = side ? a : a + 1;
+            l->tile_portals[p.tile].push_back(l->portals.size());
+            l->portals.push_back(p);
+        }
+    };
+
+    // Entrances are maximal runs of walkable pairs along a border
+    for (unsigned tr = 0; tr < tiles_high; tr++) {
+        for (unsigned tc = 0; tc < tiles_wide; tc++) {
+            unsigned row_from = tr * size, col_from = tc * size;
+            unsigned row_to = std::min(row_from + size, ca.height);
+            unsigned col_to = std::min(col_from + size, ca.width);
+
+            // Right border
+            if (tc + 1 < tiles_wide) {
+                unsigned col = col_to - 1;
+                unsigned start = row_from;
+                for (unsigned row = row_from; row <= row_to; row++) {
+                    bool open = row < row_to &&
+                        walkable(row, col) && walkable(row, col + 1);
+                    if (!open) {
+                        for (unsigned mid : spread(start, row)) {
+                            link(mid, col, mid, col + 1);
+                        }
+                        start = row + 1;
+                    }
+                }
+            }
+
+            // Bottom border
+            if (tr + 1 < tiles_high) {
+                unsigned row = row_to - 1;
+                unsigned start = col_from;
+                for (unsigned col = col_from; col <= col_to; col++) {
+                    bool open = col < col_to &&
+                        walkable(row, col) && walkable(row + 1, col);
+                    if (!open) {
+                        for (unsigned mid : spread(start, col)) {
+                            link(row, mid, row + 1, mid);
+                        }
+                        start = col + 1;
+                    }
+                }
+            }
+        }
+    }
+
+    layout.reset(l);
+    portal_costs.resize(ca.tiles.size());
+    exit_costs.resize(ca.tiles.size());
+}
+
+void TileGraph::local_search(
+    const CA &ca, unsigned tile,
+    const Sources &sources, ArenaVector<double> &out) const
+{
+    const unsigned size = CA::tile_size;
+    unsigned row_from = (tile / ca.tiles_wide) * size;
+    unsigned col_from = (tile % ca.tiles_wide) * size;
+    unsigned row_to = std::min(row_from + size, ca.height);
+    unsigned col_to = std::min(col_from + size, ca.width);
+
+    out.assign(size * size, infinity);
+    Heap heap = arena_heap(*ca.arena);
+    for (auto &s : sources) {
+        unsigned i = (s.first.first - row_from) * size
+            + (s.first.second - col_from);
+        if (s.second < out[i]) {
+            out[i] = s.second;
+            heap.push(Entry(s.second, i));
+        }
+    }
+
+    while (!heap.empty()) {
+        Entry top = heap.top();
+        heap.pop();
+        unsigned i = top.second;
+        if (top.first > out[i]) {
+            continue;
+        }
+        unsigned row = row_from + i / size, col = col_from + i % size;
+        double next = top.first + ca.accrual(ca.cell(row, col).type);
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                int r = row + dr, c = col + dc;
+                if (r < (int) row_from || r >= (int) row_to ||
+                    c < (int) col_from || c >= (int) col_to ||
+                    !(ca.cell(r, c).type & WalkableCells))
+                {
+                    continue;
+                }
+                unsigned j = (r - row_from) * size + (c - col_from);
+                if (next < out[j]) {
+                    out[j] = next;
+                    heap.push(Entry(next, j));
+                }
+            }
+        }
+    }
+}
+
+void TileGraph::refresh(const CA &ca, unsigned tile) {
+    const unsigned size = CA::tile_size;
+    unsigned row_from = (tile / ca.tiles_wide) * size;
+    unsigned col_from = (tile % ca.tiles_wide) * size;
+    auto local = [&](const Portal &p) {
+        return (p.row - row_from) * size + (p.col - col_from);
+    };
+
+    const auto &portals = layout->tile_portals[tile];
+    size_t k = portals.size();
+    ArenaVector<double> out{ArenaAllocator<double>(*ca.arena)};
+    Sources sources{ArenaAllocator<Source>(*ca.arena)};
+
+    // Portal to portal
+    auto &costs = portal_costs[tile];
+    costs.assign(k * k, infinity);
+    for (size_t q = 0; q < k; q++) {
+        const Portal &target = layout->portals[portals[q]];
+        sources.assign(1, Source(CellPosition(target.row, target.col), 0.0));
+        local_search(ca, tile, sources, out);
+        for (size_t p = 0; p < k; p++) {
+            costs[p * k + q] = out[local(layout->portals[portals[p]])];
+        }
+    }
+
+    // Portal to exits of the tile
+    auto &exits = exit_costs[tile];
+    exits.assign(k, infinity);
+    if (!layout->tile_exits[tile].empty()) {
+        sources.clear();
+        for (auto &es : layout->tile_exits[tile]) {
+            sources.push_back({es, 0.0});
+        }
+        local_search(ca, tile, sources, out);
+        for (size_t p = 0; p < k; p++) {
+            exits[p] = out[local(layout->portals[portals[p]])];
+        }
+    }
+}
+
+void TileGraph::solve(CA &ca, const People *targets) {
+    // Refresh tiles with changed occupancy or smoke
+    for (unsigned t = 0; t < ca.tiles.size(); t++) {
+        if (ca.tiles[t].dirty) {
+            refresh(ca, t);
+            ca.tiles[t].dirty = false;
+        }
+    }
+
+    // Search the abstract graph from the exits
+    const auto &portals = layout->portals;
+    portal_distance.assign(portals.size(), infinity);
+    Heap heap = arena_heap(*ca.arena);
+    for (unsigned g = 0; g < portals.size(); g++) {
+        double d = exit_costs[portals[g].tile][portals[g].local];
+        if (d < infinity) {
+            portal_distance[g] = d;
+            heap.push(Entry(d, g));
+        }
+    }
+    while (!heap.empty()) {
+        Entry top = heap.top();
+        heap.pop();
+        unsigned g = top.second;
+        if (top.first > portal_distance[g]) {
+            continue;
+        }
+        const Portal &q = portals[g];
+        const auto &tile_portals = layout->tile_portals[q.tile];
+        size_t k = tile_portals.size();
+
+        // Portals of the same tile reach q locally
+        for (size_t p = 0; p < k; p++) {
+            double d = top.first + portal_costs[q.tile][p * k + q.local];
+            unsigned h = tile_portals[p];
+            if (d < portal_distance[h]) {
+                portal_distance[h] = d;
+                heap.push(Entry(d, h));
+            }
+        }
+
+        // The partner steps onto q
+        double d = top.first + ca.accrual(ca.cell(q.row, q.col).type);
+        if (d < portal_distance[q.partner]) {
+            portal_distance[q.partner] = d;
+            heap.push(Entry(d, q.partner));
+        }
+    }
+
+    // Tiles to refine
+    ArenaVector<bool> refine(ca.tiles.size(), targets == nullptr,
+        ArenaAllocator<bool>(*ca.arena));
+    if (targets != nullptr) {
+        for (auto &t : *targets) {
+            for (int dr = -1; dr <= 1; dr++) {
+                for (int dc = -1; dc <= 1; dc++) {
+                    int r = t.first + dr, c = t.second + dc;
+                    if (ca.cell_check(r, c)) {
+                        refine[ca.tile_index(r, c)] = true;
+                    }
+                }
+            }
+        }
+    }
+
+    // Local refinement seeded by exits and portals
+    const unsigned size = CA::tile_size;
+    ArenaVector<double> out{ArenaAllocator<double>(*ca.arena)};
+    Sources sources{ArenaAllocator<Source>(*ca.arena)};
+    for (unsigned t = 0; t < ca.tiles.size(); t++) {
+        if (!refine[t]) {
+            continue;
+        }
+        sources.clear();
+        for (auto &es : layout->tile_exits[t]) {
+            sources.push_back({es, 0.0});
+        }
+        for (unsigned g : layout->tile_portals[t]) {
+            if (portal_distance[g] < infinity) {
+                sources.push_back({
+                    CellPosition(portals[g].row, portals[g].col),
+                    portal_distance[g]});
+            }
+        }
+        local_search(ca, t, sources, out);
+
+        unsigned row_from = (t / ca.tiles_wide) * size;
+        unsigned col_from = (t % ca.tiles_wide) * size;
+        unsigned row_to = std::min(row_from + size, ca.height);
+        unsigned col_to = std::min(col_from + size, ca.width);
+        for (unsigned row = row_from; row < row_to; row++) {
+            for (unsigned col = col_from; col < col_to; col++) {
+                double d = out[(row - row_from) * size + (col - col_from)];
+                ca.cell(row, col).exit_distance =
+                    d < (double) UINT_MAX ? (unsigned) d : UINT_MAX;
+            }
+        }
+    }
+}
@@ -0,0 +1,100 @@
+/**
+ * @file hierarchy.h
+ * Hierarchical (tile graph) exit distance solver interface.
+ */
+
+#ifndef __hierarchy_h
+#define __hierarchy_h
+
+#include <vector>
+#include <memory>
+
+#include "evacuation.h"
+
+namespace Evacuation {
+
+/**
+ * Two-level exit distance solver over the CA tiles.
+ *
+ * Every maximal run of walkable cells along a border of two adjacent
+ * tiles is an entrance. The entrance is split into segments of at most
+ * four cells; the cells in the middle of each segment on either side
+ * are portals, linked by a single step. For each tile the solver
+ * keeps the local portal-to-portal and exit-to-portal distances, which
+ * are recomputed only for tiles whose occupancy or smoke changed. A
+ * step then searches the small abstract graph of portals and refines
+ * the field inside the tiles around the people only.
+ *
+ * Accuracy contract: the field is exact for paths that stay within one
+ * tile and an upper bound of the exact field otherwise, as paths may
+ * only cross a tile border straight through a portal pair (no diagonal
+ * crossings, no crossings away from the middles of entrance segments). Cells
+ * outside the refined tiles keep stale distances, like the bounded
+ * Dijkstra solve.
+ */
+class TileGraph {
+public:
+    /** Build the portal layout of a CA. */
+    explicit TileGraph(const CA &ca);
+
+    /**
+     * Recompute exit distances.
+     * @param ca automaton to solve (the one the graph was built for)
+     * @param targets people whose moves read the distances
+     * (nullptr = refine every tile)
+     */
+    void solve(CA &ca, const People *targets);
+
+private:
+    /** Border cell linked to a cell of the adjacent tile. */
+    struct Portal {
+        /// Position of the cell
+        unsigned row, col;
+        /// Tile of the cell
+        unsigned tile;
+        /// Index of the portal within its tile
+        unsigned local;
+        /// Portal on the other side of the border
+        unsigned partner;
+    };
+
+    /** Static geometry shared by copies of the graph. */
+    struct Layout {
+        /// All portals
+        std::vector<Portal> portals;
+        /// Portals of each tile
+        std::vector<std::vector<unsigned>> tile_portals;
+        /// Exit cells of each tile
+        std::vector<std::vector<CellPosition>> tile_exits;
+    };
+
+    /// Portal layout
+    std::shared_ptr<const Layout> layout;
+    /// Per tile, local distance from portal i to portal j at [i * k + j]
+    std::vector<std::vector<double>> portal_costs;
+    /// Per tile, local distance from each portal to the nearest exit
+    std::vector<std::vector<double>> exit_costs;
+    /// Distance of each portal to the nearest exit
+    std::vector<double> portal_distance;
+
+    /// Source cell with its initial distance
+    using Source = std::pair<CellPosition, double>;
+    /// Source cells (from the step arena)
+    using Sources = ArenaVector<Source>;
+
+    /** Recompute local distances of a tile. */
+    void refresh(const CA &ca, unsigned tile);
+
+    /**
+     * Multi-source Dijkstra restricted to a tile.
+     * @param sources source cells with initial distances
+     * @param out distances of the tile cells (row-major within the tile)
+     */
+    void local_search(
+        const CA &ca, unsigned tile, const Sources &sources,
+        ArenaVector<double> &out) const;
+};
+
+} // end of namespace
+
+#endif
@@ -6,6 +6,9 @@
 #pragma GCC diagnostic ignored "-Wunused-result"
 
 #include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
 #include <ctime>
 
 #include <unistd.h>
@@ -14,67 +17,421 @@
 
 #include "evacuation.h"
 #include "bitmap.h"
+#include "runner.h"
+#include "sweep.h"
+#include "server.h"
 
 /** --help string. */
 static const char *helpstr =
 "Program for simulating evacuation of building.\n"
 "Usage: evac INPUT [OPTIONS] ...\n"
+"       evac --sweep SPEC [-j N] [--output FILE]\n"
+"       evac --serve SOCKET [-j N]\n"
 "  -h            : show this help and exit\n"
 "  -t <DELAY>    : set delay of next step of evolution in ms, default 300\n"
 "  -p <N>        : number of people to evacuate, default 100\n"
 "  -s <N>        : number of cells with smoke, default 0\n"
-"  -r <N>		 : number os simulation runs";
+"  -r <N>		 : number os simulation runs (maximum with --target-ci)\n"
+"  -S <SEED>     : seed of the first run, default current time\n"
+"  -j <N>        : number of worker threads, default 1\n"
+"  -c <FILE>     : convert INPUT to a native map FILE and exit\n"
+"  --checkpoint <STEP>:<FILE>\n"
+"                : store the first run to FILE after STEP steps (smoke\n"
+"                  spreading inline only, not with --domains)\n"
+"  --param <NAME>=<VALUE>\n"
+"                : set a model parameter (time_step, cell_width,\n"
+"                  chaos_rate, smoke_spreading_rate, occupied_distance,\n"
+"                  smoke_distance, friction), may be repeated\n"
+"  --config <FILE>\n"
+"                : set model parameters from FILE of NAME = VALUE lines\n"
+"  --solver <NAME>\n"
+"                : exit distance solver: dijkstra (exact, default) or\n"
+"                  hierarchical (tile graph, upper bound, see hierarchy.h)\n"
+"                  or exits (exact, keeps the two nearest exits per cell)\n"
+"                  or compact (exact, over the walkable cells only)\n"
+"  --update <RULE>[:<THREADS>]\n"
+"                : pedestrian update: sequential (random order, default) or\n"
+"                  local (sequential, blockwise random order of nearby\n"
+"                  people) or parallel (synchronous, conflicts resolved\n"
+"                  by friction) or reserve (concurrent atomic claims of\n"
+"                  cells); parallel and reserve use THREADS threads\n"
+"                  picking moves, default 1\n"
+"  --domains <N> : split the model into N row bands evolved by N worker\n"
+"                  processes (see domain.h), default 1\n"
+"  --smoke-spread <MODE>\n"
+"                : smoke spreading: inline (with the people, default) or\n"
+"                  lazy (simulated apart, step by step, see smoke.h) or\n"
+"                  ahead (simulated apart by a thread of its own)\n"
+"  --block-exit <EXIT>:<STEP>\n"
+"                : wall up exit EXIT (numbered in row-major order from 0)\n"
+"                  after STEP steps, may be repeated\n"
+"  --target-ci <METRIC>:<WIDTH>\n"
+"                : stop once the 95 % CI half-width of METRIC (time, smoke,\n"
+"                  moves, evac, max_smoke) is below WIDTH times its mean\n"
+"  --batch <N>   : runs between two --target-ci checks, default 10\n"
+"  --restore     : INPUT is a checkpoint, continue it\n"
+"  --fork        : INPUT is a checkpoint, run N reseeded runs from it\n"
+"  --sweep <SPEC>: run the parameter sweep described in SPEC (see sweep.h)\n"
+"  --output <FILE>\n"
+"                : write the sweep results table to FILE, default stdout\n"
+"  --serve <SOCKET>\n"
+"                : serve simulation jobs on a Unix socket (see server.h)\n"
+"  --profile     : report heap allocations of the steps (a build with\n"
+"                  make PROFILE=1 only, which counts by replacing the\n"
+"                  global operator new)\n"
+"  --huge-pages <MODE>\n"
+"                : back the cell planes and solver workspaces by huge\n"
+"                  pages: off (default), advise (madvise(MADV_HUGEPAGE))\n"
+"                  or hugetlb (hugetlbfs pool, advise once it runs out)\n"
+"  --pin <POLICY>: pin worker threads to cores: none (default), compact\n"
+"                  (a NUMA node at a time) or spread (alternating nodes);\n"
+"                  update workers first touch their bands of the cells\n"
+"                  (see placement.h)\n";
+
+/** Long options. */
+static const struct option longopts[] = {
+    {"help", no_argument, nullptr, 'h'},
+    {"checkpoint", required_argument, nullptr, 'C'},
+    {"param", required_argument, nullptr, 'P'},
+    {"config", required_argument, nullptr, 'G'},
+    {"solver", required_argument, nullptr, 'L'},
+    {"block-exit", required_argument, nullptr, 'X'},
+    {"update", required_argument, nullptr, 'U'},
+    {"domains", required_argument, nullptr, 'D'},
+    {"target-ci", required_argument, nullptr, 'T'},
+    {"batch", required_argument, nullptr, 'B'},
+    {"restore", no_argument, nullptr, 'R'},
+    {"fork", no_argument, nullptr, 'F'},
+    {"sweep", required_argument, nullptr, 'W'},
+    {"output", required_argument, nullptr, 'O'},
+    {"serve", required_argument, nullptr, 'V'},
+    {"profile", no_argument, nullptr, 'Q'},
+    {"huge-pages", required_argument, nullptr, 'H'},
+    {"smoke-spread", required_argument, nullptr, 'K'},
+    {"pin", required_argument, nullptr, 'N'},
+    {nullptr, 0, nullptr, 0}
+};
 
 /** Entry point. */
 int main(int argc, char **argv) {
     // Arguments:
-    long delay = 0;    // simulation delay (microseconds)
-    int people = 100;   // persons to evacuate
-    int smoke = 0;     // cells with smoke
+    Evacuation::RunOptions options; // replicate options
+    options.seed = std::time(0);
     int simulations = 1; // simulation runs
+    std::string convert; // native map output
+    bool restore = false; // continue a checkpoint
+    bool fork = false;    // fork replicates from a checkpoint
+    std::string config;   // model parameters file
+    std::vector<std::string> assignments; // model parameter assignments
+    Evacuation::Solver solver = Evacuation::DijkstraSolver; // field solver
+    Evacuation::Update update = Evacuation::SequentialUpdate; // update rule
+    unsigned update_threads = 1; // threads of the parallel update
+    Evacuation::SmokeSpread spread = Evacuation::InlineSmoke; // smoke mode
+    std::string sweep;    // sweep specification
+    std::string output;   // sweep results table
+    std::string serve;    // job server socket
+    Evacuation::HugePages pages = Evacuation::NoHugePages; // plane backing
+    Evacuation::Pinning pinning = Evacuation::NoPinning; // worker pinning
 
     // Process program arguments
     int c;              // reading the options
-    int opt_cnt = 1;    // used for locating positional argument
-    while ((c = getopt(argc, argv, "ht:p:s:r:")) != -1) {
-        opt_cnt += 2;
+    while ((c = getopt_long(argc, argv, "ht:p:s:r:S:j:c:", longopts, nullptr))
+        != -1)
+    {
         switch (c) {
             case 'h':
                 fprintf(stderr, "%s", helpstr);
                 return EXIT_SUCCESS;
             case 't':
-                delay = 1000 * std::stoi(optarg); // convert to microseconds
+                // convert to microseconds
+                options.delay = 1000 * std::stoi(optarg);
                 break;
             case 'p':
-                people = std::stoi(optarg);
+                options.people = std::stoi(optarg);
                 break;
             case 's':
-                smoke = std::stoi(optarg);
+                options.smoke = std::stoi(optarg);
                 break;
             case 'r':
                 simulations = std::stoi(optarg);
                 break;
+            case 'S':
+                options.seed = std::stoull(optarg);
+                break;
+            case 'j':
+                options.threads = std::stoi(optarg);
+                break;
+            case 'c':
+                convert = optarg;
+                break;
+            case 'C':
+            {
+                std::string arg = optarg;
+                size_t colon = arg.find(':');
+                if (colon == std::string::npos) {
+                    std::cerr << "Error: invalid checkpoint specification\n";
+                    return EXIT_FAILURE;
+                }
+                options.checkpoint_step = std::stoi(arg.substr(0, colon));
+                options.checkpoint = arg.substr(colon + 1);
+                break;
+            }
+            case 'P':
+                assignments.push_back(optarg);
+                break;
+            case 'G':
+                config = optarg;
+                break;
+            case 'L':
+                if (std::string(optarg) == "dijkstra") {
+                    solver = Evacuation::DijkstraSolver;
+                }
+                else if (std::string(optarg) == "hierarchical") {
+                    solver = Evacuation::HierarchicalSolver;
+                }
+                else if (std::string(optarg) == "exits") {
+                    solver = Evacuation::MultiExitSolver;
+                }
+                else if (std::string(optarg) == "compact") {
+                    solver = Evacuation::CompactSolver;
+                }
+                else {
+                    std::cerr << "Error: unknown solver " << optarg << "\n";
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'U':
+            {
+                std::string arg = optarg;
+                size_t colon = arg.find(':');
+                std::string rule = arg.substr(0, colon);
+                if (rule == "sequential") {
+                    update = Evacuation::SequentialUpdate;
+                }
+                else if (rule == "parallel") {
+                    update = Evacuation::ParallelUpdate;
+                }
+                else if (rule == "reserve") {
+                    update = Evacuation::ReservationUpdate;
+                }
+                else if (rule == "local") {
+                    update = Evacuation::LocalUpdate;
+                }
+                else {
+                    std::cerr << "Error: unknown update rule " << rule << "\n";
+                    return EXIT_FAILURE;
+                }
+                if (colon != std::string::npos) {
+                    update_threads = std::stoi(arg.substr(colon + 1));
+                }
+                break;
+            }
+            case 'D':
+                options.domains = std::stoi(optarg);
+                break;
+            case 'K':
+                if (std::string(optarg) == "inline") {
+                    spread = Evacuation::InlineSmoke;
+                }
+                else if (std::string(optarg) == "lazy") {
+                    spread = Evacuation::LazySmoke;
+                }
+                else if (std::string(optarg) == "ahead") {
+                    spread = Evacuation::AheadSmoke;
+                }
+                else {
+                    std::cerr << "Error: unknown smoke spreading mode "
+                        << optarg << "\n";
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'X':
+            {
+                std::string arg = optarg;
+                size_t colon = arg.find(':');
+                if (colon == std::string::npos) {
+                    std::cerr << "Error: invalid exit blocking specification\n";
+                    return EXIT_FAILURE;
+                }
+                options.blocked_exits.push_back({
+                    (unsigned) std::stoul(arg.substr(0, colon)),
+                    std::stod(arg.substr(colon + 1))});
+                break;
+            }
+            case 'T':
+            {
+                std::string arg = optarg;
+                size_t colon = arg.find(':');
+                if (colon == std::string::npos) {
+                    std::cerr << "Error: invalid CI target specification\n";
+                    return EXIT_FAILURE;
+                }
+                try {
+                    options.target_metric =
+                        Evacuation::Statistics::metric(arg.substr(0, colon));
+                }
+                catch (std::exception &e) {
+                    std::cerr << "Error: " << e.what() << std::endl;
+                    return EXIT_FAILURE;
+                }
+                options.target_width = std::stod(arg.substr(colon + 1));
+                break;
+            }
+            case 'B':
+                options.batch = std::stoi(optarg);
+                break;
+            case 'R':
+                restore = true;
+                break;
+            case 'F':
+                fork = true;
+                break;
+            case 'W':
+                sweep = optarg;
+                break;
+            case 'O':
+                output = optarg;
+                break;
+            case 'V':
+                serve = optarg;
+                break;
+            case 'Q':
+                if (!Evacuation::counting_allocations) {
+                    std::cerr << "Error: --profile needs a build with "
+                        "make PROFILE=1\n";
+                    return EXIT_FAILURE;
+                }
+                options.profile = true;
+                break;
+            case 'H':
+                if (std::string(optarg) == "off") {
+                    pages = Evacuation::NoHugePages;
+                }
+                else if (std::string(optarg) == "advise") {
+                    pages = Evacuation::AdvisedHugePages;
+                }
+                else if (std::string(optarg) == "hugetlb") {
+                    pages = Evacuation::HugeTlbPages;
+                }
+                else {
+                    std::cerr << "Error: unknown huge page mode " << optarg
+                        << "\n";
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'N':
+                if (std::string(optarg) == "none") {
+                    pinning = Evacuation::NoPinning;
+                }
+                else if (std::string(optarg) == "compact") {
+                    pinning = Evacuation::CompactPinning;
+                }
+                else if (std::string(optarg) == "spread") {
+                    pinning = Evacuation::SpreadPinning;
+                }
+                else {
+                    std::cerr << "Error: unknown pinning policy " << optarg
+                        << "\n";
+                    return EXIT_FAILURE;
+                }
+                break;
             default:
                 return EXIT_FAILURE;
         }
     }
+    Evacuation::Placement::configure(pages, pinning);
+
+    // Job server
+    if (!serve.empty()) {
+        try {
+            Evacuation::Server server(serve, options.threads);
+            server.serve();
+        }
+        catch (std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    // Parameter sweep
+    if (!sweep.empty()) {
+        try {
+            Evacuation::Sweep spec = Evacuation::Sweep::load(sweep);
+            if (output.empty()) {
+                spec.run(std::cout, options.threads);
+            }
+            else {
+                std::ofstream out(output);
+                if (!out) {
+                    throw std::runtime_error("could not open output file");
+                }
+                spec.run(out, options.threads);
+            }
+        }
+        catch (std::exception &e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
     // Check positional argument
-    if (argc - opt_cnt != 1) {
+    if (argc - optind != 1 || (restore && fork)) {
         std::cerr << "Error: invalid arguments\n";
         return EXIT_FAILURE;
     }
-    char *filename = argv[opt_cnt];
+    if (!options.checkpoint.empty() && spread != Evacuation::InlineSmoke) {
+        std::cerr << "Error: checkpoints need inline smoke spreading\n";
+        return EXIT_FAILURE;
+    }
+    char *filename = argv[optind];
+    if (restore) {
+        // A restored run continues a single trajectory
+        simulations = 1;
+        options.reseed = false;
+    }
+    options.populate = !restore && !fork;
 
     // Load the model
     try {
-        // Seed
-        std::srand(std::time(0));
+        // Load model from a bitmap, native map or checkpoint
+        Evacuation::CA model = restore || fork ?
+            Evacuation::CA::restore(filename) :
+            Evacuation::CA::load(filename);
 
-        // Load model from a bitmap
-        Evacuation::CA model = Evacuation::CA::load(filename);
+        // Model parameters (on top of those of a checkpoint)
+        Evacuation::ModelParams params = model.params();
+        if (!config.empty()) {
+            params.load(config);
+        }
+        for (auto &a : assignments) {
+            params.set(a);
+        }
+        model.set_params(params);
+
+        // Regions people could never leave
+        const Evacuation::Unreachable &trapped = model.unreachable();
+        if (trapped.regions > 0) {
+            std::cerr << "Warning: " << trapped.regions << " regions ("
+                << trapped.cells << " cells, " << trapped.spawns
+                << " spawn cells, " << trapped.people
+                << " people) cannot reach an exit\n";
+        }
+
+        // Convert only; the static field is the exact one of the default
+        // solver, whatever --solver says
+        if (!convert.empty()) {
+            model.save(convert);
+            return EXIT_SUCCESS;
+        }
+
+        model.set_solver(solver);
+        model.set_update(update, update_threads);
+        model.set_smoke(spread);
 
         // Uncoment this to open image with xdg-open
-        if (delay > 0) {
+        if (options.delay > 0) {
             // Display exit distances
             Bitmap::display_distances(model);
 
@@ -88,40 +445,20 @@ int main(int argc, char **argv) {
 
         // Simulate n times and display aggregate statistics
         Evacuation::Statistics stat;
-        stat.pedestrians = people;
-        for(int i = 0; i < simulations; i++) {
-            // Copy the CA
-            Evacuation::CA ca = model.copy();
-
-            // Populate the CA
-            ca.add_people(people);
-            ca.add_smoke(smoke);
-        
-            // Evolve CA in loop until CA can't change its states
-            while (ca.evolve()) {
-                if (delay > 0) {
-                    // Show the current state of CA
-                    Bitmap::display_distances(ca);
-                    ca.show();
-                    usleep(delay);
-                }
-            }
-            if (delay > 0) {
-            	// Show the final state of CA
-                ca.show();
-            }
-
-            // Collect statistics
-            stat.aggregate(ca.stat);
-            
-            // Progress bar
-            //std::cout << "\r" << 100.0 * i / simulations << " %";
-            //std::cout << std::flush;
-        }
+        stat.pedestrians =
+            options.populate ? options.people : model.stat.pedestrians;
+        Evacuation::Runner runner(model, options);
+        runner.run_until(simulations, stat);
 
         // Normalize and display statistics
-        stat.normalize(simulations);
-        std::cout << stat.str();
+        stat.normalize(stat.runs());
+        std::cout << stat.str(model.params());
+        if (options.profile) {
+            std::cout << runner.profile().str();
+        }
+        if (Evacuation::Placement::enabled()) {
+            std::cout << Evacuation::Placement::report();
+        }
     }
     catch (std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
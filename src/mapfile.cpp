@@ -0,0 +1,260 @@
+/**
+ * @file mapfile.cpp
+ * Native (memory-mapped) map format implementation.
+ */
+
+#include <fstream>
+#include <cstring>
+#include <climits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapfile.h"
+
+using namespace Evacuation;
+
+constexpr char MapFile::signature[8];
+constexpr uint32_t MapFile::version;
+constexpr const char *MapFile::extension;
+
+/// Byte order mark as written by the producer.
+static constexpr uint32_t byte_order_mark = 0x01020304;
+
+/** @return offset rounded up to 8 bytes */
+static inline uint64_t align(uint64_t offset) {
+    return (offset + 7) & ~(uint64_t) 7;
+}
+
+MapFile::MapFile(const std::string &filename) :
+    data{MAP_FAILED}, size{0}, header{nullptr}
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::invalid_argument("could not open input file");
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(Header)) {
+        close(fd);
+        throw std::invalid_argument("invalid native map file");
+    }
+    size = st.st_size;
+    data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::invalid_argument("could not map input file");
+    }
+    header = static_cast<const Header *>(data);
+
+    // Validate the header before handing out any plane; sections are
+    // aligned and hold count items within the mapping (written so that
+    // a crafted count cannot overflow)
+    uint64_t cells = (uint64_t) header->height * header->width;
+    auto fits = [this](uint64_t offset, uint64_t count, size_t item) {
+        return offset % 8 == 0 && offset <= size &&
+            count <= (size - offset) / item;
+    };
+    bool valid =
+        std::memcmp(header->magic, signature, sizeof(signature)) == 0 &&
+        header->byte_order == byte_order_mark &&
+        header->version == version &&
+        header->types_offset >= sizeof(Header) &&
+        fits(header->types_offset, cells, sizeof(uint16_t)) &&
+        fits(header->exits_offset, header->exits, 2 * sizeof(uint32_t)) &&
+        (header->distances_offset == 0 ||
+         fits(header->distances_offset, cells, sizeof(uint32_t)));
+
+    // Every type is a single cell type and every exit an exit cell
+    const uint16_t *plane = valid ? types() : nullptr;
+    for (uint64_t i = 0; valid && i < cells; i++) {
+        valid = valid_cell_type(plane[i]);
+    }
+    const uint32_t *list = valid ? exits() : nullptr;
+    for (uint64_t i = 0; valid && i < header->exits; i++) {
+        uint32_t row = list[2*i], col = list[2*i + 1];
+        valid = row < header->height && col < header->width &&
+            (plane[(size_t) row * header->width + col] &
+                (Exit | PersonAtExit));
+    }
+    if (!valid) {
+        munmap(data, size);
+        throw std::invalid_argument("invalid native map file");
+    }
+
+    // Planes are read front to back when populating a CA
+    madvise(data, size, MADV_WILLNEED);
+}
+
+MapFile::~MapFile() {
+    if (data != MAP_FAILED) {
+        munmap(data, size);
+    }
+}
+
+const uint16_t *MapFile::types() const {
+    return reinterpret_cast<const uint16_t *>(section(header->types_offset));
+}
+
+const uint32_t *MapFile::distances() const {
+    if (header->distances_offset == 0) {
+        return nullptr;
+    }
+    return reinterpret_cast<const uint32_t *>(
+        section(header->distances_offset));
+}
+
+const uint32_t *MapFile::exits() const {
+    return reinterpret_cast<const uint32_t *>(section(header->exits_offset));
+}
+
+bool MapFile::is_native(const std::string &filename) {
+    std::ifstream in(filename, std::ios::binary);
+    char magic[sizeof(signature)];
+    if (!in.read(magic, sizeof(magic))) {
+        return false;
+    }
+    return std::memcmp(magic, signature, sizeof(signature)) == 0;
+}
+
+CA MapFile::load(const std::string &filename) {
+    MapFile map(filename);
+    unsigned height = map.height();
+    unsigned width = map.width();
+    CA ca(height, width);
+
+    // Copy the type plane
+    const uint16_t *types = map.types();
+    for (unsigned row = 0; row < height; row++) {
+        for (unsigned col = 0; col < width; col++) {
+            ca.cell(row, col).type = (CellType) types[(size_t) row * width + col];
+        }
+    }
+
+    // Exit states (validated with the type plane)
+    const uint32_t *exits = map.exits();
+    for (size_t i = 0; i < map.exit_count(); i++) {
+        ca.exit_states.push_back(CellPosition(exits[2*i], exits[2*i + 1]));
+    }
+
+    // Static exit field
+    ca.group_exits();
+    ca.label_regions();
+    ca.recount();
+    const uint32_t *distances = map.distances();
+    if (distances == nullptr) {
+        ca.recompute_shortest_paths();
+        return ca;
+    }
+
+    // The plane has to descend to the exits: exits at 0, every other
+    // reachable cell finite with a walkable neighbour closer to an exit
+    auto descends = [&](unsigned row, unsigned col) {
+        uint32_t d = distances[(size_t) row * width + col];
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                long r = (long) row + dr, c = (long) col + dc;
+                if ((dr == 0 && dc == 0) || r < 0 || c < 0 ||
+                    r >= height || c >= width)
+                {
+                    continue;
+                }
+                size_t i = (size_t) r * width + c;
+                if ((types[i] & WalkableCells) && distances[i] < d) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+    for (unsigned row = 0; row < height; row++) {
+        for (unsigned col = 0; col < width; col++) {
+            uint32_t d = distances[(size_t) row * width + col];
+            CellType type = ca.cell(row, col).type;
+            bool valid = true;
+            if (type & (Exit | PersonAtExit)) {
+                valid = d == 0;
+            }
+            else if ((type & WalkableCells) &&
+                ca.reachable[ca.cell_index(row, col)])
+            {
+                valid = d != UINT_MAX && descends(row, col);
+            }
+            if (!valid) {
+                throw std::invalid_argument("invalid native map file");
+            }
+            ca.cell(row, col).exit_distance = d;
+        }
+    }
+    return ca;
+}
+
+void MapFile::store(CA &ca, const std::string &filename, bool distances) {
+    if (distances && ca.solver == HierarchicalSolver) {
+        throw std::logic_error("static distances need an exact solver");
+    }
+    uint64_t cells = (uint64_t) ca.height * ca.width;
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, signature, sizeof(signature));
+    header.byte_order = byte_order_mark;
+    header.version = version;
+    header.height = ca.height;
+    header.width = ca.width;
+    header.exits = ca.exit_states.size();
+    header.types_offset = align(sizeof(Header));
+    uint64_t offset = align(header.types_offset + cells * sizeof(uint16_t));
+    if (distances) {
+        header.distances_offset = offset;
+        offset = align(offset + cells * sizeof(uint32_t));
+    }
+    header.exits_offset = offset;
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("could not open output file");
+    }
+
+    // Pads the stream up to the next section
+    auto pad = [&out](uint64_t offset) {
+        static const char zeros[8] = {0};
+        uint64_t pos = out.tellp();
+        out.write(zeros, offset - pos);
+    };
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    pad(header.types_offset);
+    std::vector<uint16_t> types(ca.width);
+    for (unsigned row = 0; row < ca.height; row++) {
+        for (unsigned col = 0; col < ca.width; col++) {
+            types[col] = ca.cell(row, col).type;
+        }
+        out.write(reinterpret_cast<const char *>(types.data()),
+            types.size() * sizeof(uint16_t));
+    }
+
+    if (distances) {
+        pad(header.distances_offset);
+        std::vector<uint32_t> plane(ca.width);
+        for (unsigned row = 0; row < ca.height; row++) {
+            for (unsigned col = 0; col < ca.width; col++) {
+                plane[col] = ca.cell(row, col).exit_distance;
+            }
+            out.write(reinterpret_cast<const char *>(plane.data()),
+                plane.size() * sizeof(uint32_t));
+        }
+    }
+
+    pad(header.exits_offset);
+    for (auto &es : ca.exit_states) {
+        uint32_t pos[2] = {(uint32_t) es.first, (uint32_t) es.second};
+        out.write(reinterpret_cast<const char *>(pos), sizeof(pos));
+    }
+
+    if (!out) {
+        throw std::runtime_error("could not write output file");
+    }
+}
@@ -0,0 +1,135 @@
+/**
+ * @file mapfile.h
+ * Native (memory-mapped) map format interface.
+ */
+
+#ifndef __mapfile_h
+#define __mapfile_h
+
+#include <string>
+#include <cstdint>
+
+#include "evacuation.h"
+
+namespace Evacuation {
+
+/**
+ * Read-only view of a native map file mapped into memory.
+ *
+ * File layout (native byte order, sections aligned to 8 bytes):
+ *   header | type plane (uint16 per cell, row-major)
+ *          | static distance plane (uint32 per cell, optional)
+ *          | exit list (row, col pairs of uint32)
+ *
+ * Loading copies the planes into the tiled cells of a CA once, so it
+ * still takes time and memory proportional to the cells; what the format
+ * saves is decoding the bitmap and, with the static distance plane,
+ * solving the initial exit field.
+ */
+class MapFile {
+public:
+    /** On-disk header. */
+    struct Header {
+        /** File signature, see MapFile::signature. */
+        char magic[8];
+        /** Byte order mark (0x01020304 as written by the producer). */
+        uint32_t byte_order;
+        /** Format version. */
+        uint32_t version;
+        /** Number of rows. */
+        uint32_t height;
+        /** Number of columns. */
+        uint32_t width;
+        /** Number of exit cells. */
+        uint64_t exits;
+        /** Offset of the type plane. */
+        uint64_t types_offset;
+        /** Offset of the distance plane, 0 if not present. */
+        uint64_t distances_offset;
+        /** Offset of the exit list. */
+        uint64_t exits_offset;
+    };
+
+    /** File signature. */
+    static constexpr char signature[8] = {'E','V','A','C','M','A','P','\0'};
+    /** Current format version. */
+    static constexpr uint32_t version = 1;
+    /** Conventional file extension. */
+    static constexpr const char *extension = ".evm";
+
+    /**
+     * Map a native map file.
+     * @param filename name of input file
+     * @throw invalid_argument if the file could not be mapped or is malformed
+     * (a section outside the file, a type that is not a single CellType,
+     * an exit list entry that is not an exit cell)
+     */
+    explicit MapFile(const std::string &filename);
+    ~MapFile();
+
+    MapFile(const MapFile &) = delete;
+    MapFile &operator=(const MapFile &) = delete;
+
+    /** @return number of rows */
+    unsigned height() const { return header->height; }
+
+    /** @return number of columns */
+    unsigned width() const { return header->width; }
+
+    /** @return row-major plane of cell types */
+    const uint16_t *types() const;
+
+    /** @return row-major plane of static exit distances, nullptr if absent */
+    const uint32_t *distances() const;
+
+    /** @return number of exit cells */
+    size_t exit_count() const { return header->exits; }
+
+    /** @return list of exits as (row, col) pairs */
+    const uint32_t *exits() const;
+
+    /** @return true if the file starts with the native signature */
+    static bool is_native(const std::string &filename);
+
+    /**
+     * Load model description from a native map.
+     * The static distance plane is used as the initial exit field when
+     * present, otherwise the field is solved as usual.
+     * @param filename name of input file
+     * @return instance of CA class
+     * @throw invalid_argument if failed to process input file or the
+     * distance plane does not descend to the exits (an exit not at 0, a
+     * reachable cell at infinity or without a closer walkable neighbour)
+     */
+    static CA load(const std::string &filename);
+
+    /**
+     * Store model description as a native map.
+     * @param ca model to store (exit distances must be up to date)
+     * @param filename name of output file
+     * @param distances store the static distance plane
+     * @throw runtime_error if failed to write output file
+     * @throw logic_error if storing distances of the hierarchical solver,
+     * an upper bound of the field
+     */
+    static void store(
+        CA &ca, const std::string &filename, bool distances = true
+    );
+
+private:
+    /// Mapped memory.
+    void *data;
+    /// Size of the mapping in bytes.
+    size_t size;
+    /// Header at the beginning of the mapping.
+    const Header *header;
+
+    /** @return pointer to the section at the specified offset */
+    inline const char *section(uint64_t offset) const {
+        return static_cast<const char *>(data) + offset;
+    }
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,380 @@
+/**
+ * @file placement.cpp
+ * Memory and thread placement implementation.
+ */
+
+#include <new>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "placement.h"
+#include "pool.h"
+
+using namespace Evacuation;
+
+HugePages Placement::pages = NoHugePages;
+Pinning Placement::pinning = NoPinning;
+size_t Placement::huge_page = 2 << 20;
+std::vector<int> Placement::cores;
+std::vector<int> Placement::core_nodes;
+unsigned Placement::nodes = 1;
+
+/// Planes mapped so far
+static std::atomic<size_t> mapped_planes{0};
+/// Planes mapped from the hugetlbfs pool
+static std::atomic<size_t> hugetlb_planes{0};
+/// Planes that fell back from hugetlbfs to advised huge pages
+static std::atomic<size_t> hugetlb_fallbacks{0};
+/// Planes madvise() refused huge pages for
+static std::atomic<size_t> advise_failures{0};
+/// Bytes currently mapped and their peak
+static std::atomic<size_t> mapped_bytes{0}, peak_bytes{0};
+/// Threads the system refused to pin
+static std::atomic<size_t> pin_failures{0};
+/// Planes served from released mappings
+static std::atomic<size_t> reused_planes{0};
+
+/** Mapped plane. */
+struct Mapping {
+    /// Requested size
+    size_t bytes;
+    /// Workers its bands were spread over (0 = not spread)
+    unsigned bands;
+};
+
+/// Guards the mappings below
+static std::mutex mappings_mutex;
+/// Mappings in use (never destroyed, planes may outlive statics)
+static auto &live = *new std::unordered_map<void *, Mapping>;
+/// Released mappings kept for reuse
+static auto &released = *new std::vector<std::pair<void *, Mapping>>;
+
+/** @return cpus of a list like "0-3,8-11" */
+static std::vector<int> parse_cpulist(const std::string &list) {
+    std::vector<int> cpus;
+    std::istringstream in(list);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ?
+                first : std::stoi(range.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (std::exception &) {
+            // Blank line or malformed range
+        }
+    }
+    return cpus;
+}
+
+/** @return first line of a sysfs file, empty if it cannot be read */
+static std::string read_line(const std::string &filename) {
+    std::ifstream in(filename);
+    std::string line;
+    std::getline(in, line);
+    return line;
+}
+
+void Placement::configure(HugePages pages, Pinning pinning) {
+    if (mapped_planes > 0) {
+        throw std::logic_error("placement chosen after planes were mapped");
+    }
+    Placement::pages = pages;
+    Placement::pinning = pinning;
+
+    std::string pmd =
+        read_line("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size");
+    if (!pmd.empty()) {
+        huge_page = std::stoul(pmd);
+    }
+
+    // NUMA node of each cpu (node 0 without sysfs topology)
+    std::vector<int> cpu_node;
+    if (DIR *dir = opendir("/sys/devices/system/node")) {
+        while (dirent *entry = readdir(dir)) {
+            int node;
+            char tail;
+            if (std::sscanf(entry->d_name, "node%d%c", &node, &tail) != 1) {
+                continue;
+            }
+            std::string list = read_line(std::string(
+                "/sys/devices/system/node/") + entry->d_name + "/cpulist");
+            for (int cpu : parse_cpulist(list)) {
+                if (cpu >= (int) cpu_node.size()) {
+                    cpu_node.resize(cpu + 1, 0);
+                }
+                cpu_node[cpu] = node;
+            }
+        }
+        closedir(dir);
+    }
+
+    // Allowed cpus by node
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    std::vector<std::vector<int>> by_node;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (!CPU_ISSET(cpu, &allowed)) {
+                continue;
+            }
+            int node = cpu < (int) cpu_node.size() ? cpu_node[cpu] : 0;
+            if (node >= (int) by_node.size()) {
+                by_node.resize(node + 1);
+            }
+            by_node[node].push_back(cpu);
+        }
+    }
+    by_node.erase(
+        std::remove_if(by_node.begin(), by_node.end(),
+            [](const std::vector<int> &v) { return v.empty(); }),
+        by_node.end());
+    nodes = std::max<size_t>(by_node.size(), 1);
+    released.reserve(released_planes);
+
+    // Cores in the order workers take them
+    cores.clear();
+    core_nodes.clear();
+    size_t count = CPU_COUNT(&allowed);
+    if (pinning == SpreadPinning) {
+        for (size_t i = 0; cores.size() < count; i++) {
+            for (size_t n = 0; n < by_node.size(); n++) {
+                if (i < by_node[n].size()) {
+                    cores.push_back(by_node[n][i]);
+                    core_nodes.push_back(n);
+                }
+            }
+        }
+    }
+    else {
+        for (size_t n = 0; n < by_node.size(); n++) {
+            for (int cpu : by_node[n]) {
+                cores.push_back(cpu);
+                core_nodes.push_back(n);
+            }
+        }
+    }
+}
+
+size_t Placement::mapped_size(size_t bytes) {
+    if (pages != NoHugePages) {
+        return bytes < huge_page ?
+            0 : (bytes + huge_page - 1) / huge_page * huge_page;
+    }
+    if (pinning == NoPinning || bytes < min_mapped) {
+        return 0;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1) / page * page;
+}
+
+void *Placement::allocate(size_t bytes) {
+    size_t size = mapped_size(bytes);
+    if (size == 0) {
+        return ::operator new(bytes);
+    }
+
+    // A released plane of the same size keeps its pages and placement
+    {
+        std::lock_guard<std::mutex> lock(mappings_mutex);
+        for (auto it = released.begin(); it != released.end(); ++it) {
+            if (it->second.bytes == bytes) {
+                void *p = it->first;
+                live.emplace(p, it->second);
+                released.erase(it);
+                reused_planes++;
+                return p;
+            }
+        }
+    }
+
+    void *p = MAP_FAILED;
+    if (pages == HugeTlbPages) {
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            hugetlb_planes++;
+        }
+        else {
+            hugetlb_fallbacks++;
+        }
+    }
+    if (p == MAP_FAILED) {
+        // Over-map and trim to a huge page boundary
+        size_t align = pages == NoHugePages ? 0 : huge_page;
+        void *q = mmap(nullptr, size + align, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (q == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        char *base = static_cast<char *>(q);
+        size_t head = align ? (align - (uintptr_t) base % align) % align : 0;
+        if (head > 0) {
+            munmap(base, head);
+        }
+        if (align > head) {
+            munmap(base + head + size, align - head);
+        }
+        p = base + head;
+        if (pages != NoHugePages && madvise(p, size, MADV_HUGEPAGE) != 0) {
+            advise_failures++;
+        }
+    }
+
+    try {
+        std::lock_guard<std::mutex> lock(mappings_mutex);
+        live.emplace(p, Mapping{bytes, 0});
+    }
+    catch (...) {
+        munmap(p, size);
+        throw;
+    }
+    mapped_planes++;
+    size_t now = mapped_bytes += size;
+    size_t peak = peak_bytes;
+    while (now > peak && !peak_bytes.compare_exchange_weak(peak, now)) {}
+    return p;
+}
+
+void Placement::deallocate(void *p, size_t bytes) noexcept {
+    size_t size = mapped_size(bytes);
+    if (size == 0) {
+        ::operator delete(p);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mappings_mutex);
+        auto it = live.find(p);
+        if (it != live.end()) {
+            Mapping mapping = it->second;
+            live.erase(it);
+            if (released.size() < released.capacity()) {
+                released.emplace_back(p, mapping);
+                return;
+            }
+        }
+    }
+    munmap(p, size);
+    mapped_bytes -= size;
+}
+
+void Placement::pin(unsigned worker) {
+    if (pinning == NoPinning || cores.empty()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cores[worker % cores.size()], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        pin_failures++;
+    }
+}
+
+void Placement::spread(void *p, size_t bytes, ThreadPool &pool) {
+    size_t size = mapped_size(bytes);
+    if (size == 0 || p == nullptr) {
+        return;
+    }
+
+    // A plane reused from a released one may be in place already
+    unsigned n = pool.size();
+    {
+        std::lock_guard<std::mutex> lock(mappings_mutex);
+        auto it = live.find(p);
+        if (it == live.end() || it->second.bands == n) {
+            return;
+        }
+    }
+
+    // Bands start at page boundaries; a huge page is faulted in whole by
+    // the first thread touching it, so with huge pages they start at
+    // huge page boundaries
+    size_t page = pages == NoHugePages ? sysconf(_SC_PAGESIZE) : huge_page;
+    auto bound = [&](unsigned i) {
+        return (size_t) ((uint64_t) bytes * i / n / page * page);
+    };
+
+    // Every worker releases the pages of its band, keeping the content
+    // aside, and touches them again
+    char *plane = static_cast<char *>(p);
+    pool.broadcast([&](unsigned worker) {
+        size_t first = bound(worker);
+        size_t last = worker + 1 == n ? bytes : bound(worker + 1);
+        if (first >= last) {
+            return;
+        }
+        std::vector<char> content(plane + first, plane + last);
+        size_t end = worker + 1 == n ? size : last;
+        madvise(plane + first, end - first, MADV_DONTNEED);
+        std::memcpy(plane + first, content.data(), last - first);
+    });
+
+    std::lock_guard<std::mutex> lock(mappings_mutex);
+    live.at(p).bands = n;
+}
+
+std::string Placement::report() {
+    static const char *page_names[] = {"off", "advise", "hugetlb"};
+    static const char *pin_names[] = {"none", "compact", "spread"};
+
+    std::ostringstream out;
+    out << "Huge pages                         : " << page_names[pages];
+    if (pages != NoHugePages) {
+        out << " (" << huge_page / 1024 << " kB pages";
+        std::string thp =
+            read_line("/sys/kernel/mm/transparent_hugepage/enabled");
+        if (!thp.empty()) {
+            out << ", transparent huge pages " << thp;
+        }
+        out << ")";
+    }
+    out << "\n";
+
+    out << "Mapped planes                      : " << mapped_planes
+        << " (peak " << (peak_bytes + (1 << 20) - 1) / (1 << 20) << " MiB, "
+        << reused_planes << " reused";
+    if (hugetlb_planes > 0 || hugetlb_fallbacks > 0) {
+        out << ", " << hugetlb_planes << " from hugetlbfs, "
+            << hugetlb_fallbacks << " advised";
+    }
+    if (advise_failures > 0) {
+        out << ", " << advise_failures << " refused huge pages";
+    }
+    out << ")\n";
+
+    out << "Thread pinning                     : " << pin_names[pinning];
+    if (pinning != NoPinning) {
+        out << " over " << nodes << " NUMA node" << (nodes > 1 ? "s" : "")
+            << ", cores";
+        for (size_t i = 0; i < cores.size() && i < 16; i++) {
+            out << " " << cores[i] << (nodes > 1 ?
+                "@" + std::to_string(core_nodes[i]) : "");
+        }
+        if (cores.size() > 16) {
+            out << " ...";
+        }
+        if (pin_failures > 0) {
+            out << " (" << pin_failures << " threads not pinned)";
+        }
+    }
+    out << "\n";
+    return out.str();
+}
@@ -0,0 +1,154 @@
+/**
+ * @file placement.h
+ * Memory and thread placement interface.
+ */
+
+#ifndef __placement_h
+#define __placement_h
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+namespace Evacuation {
+
+class ThreadPool;
+
+/** Page backing of large planes. */
+enum HugePages {
+    /// Planes come from the heap
+    NoHugePages,
+    /// Planes are mapped aligned to huge pages, advised with
+    /// madvise(MADV_HUGEPAGE) (transparent huge pages)
+    AdvisedHugePages,
+    /// Planes are mapped from the hugetlbfs pool (MAP_HUGETLB), advised
+    /// huge pages once the pool runs out
+    HugeTlbPages
+};
+
+/** Pinning of worker threads. */
+enum Pinning {
+    /// Threads float
+    NoPinning,
+    /// Workers fill the cores of a NUMA node before the next node
+    CompactPinning,
+    /// Workers alternate between NUMA nodes
+    SpreadPinning
+};
+
+/**
+ * Process-wide placement of the grid planes and of worker threads.
+ *
+ * The cell plane and the solver workspaces of a CA are Planes. With huge
+ * pages, planes of at least a huge page are mapped on their own rather
+ * than taken from the heap; with pinning only, planes of at least
+ * min_mapped bytes are. Their pages land on the NUMA node of the thread
+ * first touching them: the thread copying or loading the model, which is
+ * the thread running its replicate and solving its exit distances. Cells
+ * read by the workers of the parallel and reservation updates are touched
+ * again by those workers, each its band of tile rows (see
+ * CA::set_update()). Released planes stay mapped, up to released_planes
+ * of them, and are handed out again for planes of the same size: the
+ * replicates a thread runs one after another reuse the pages, and the
+ * placement, of the previous one.
+ *
+ * Worker threads of thread pools and replicate threads are pinned to
+ * the allowed cores in the order of the pinning policy, the n-th worker
+ * to the n-th core. The settings are chosen once, by configure(),
+ * before any model is loaded.
+ */
+class Placement {
+public:
+    /**
+     * Choose the placement and read the NUMA topology.
+     * @throw logic_error if planes have been mapped already
+     */
+    static void configure(HugePages pages, Pinning pinning);
+
+    /** @return storage for a plane of the specified size */
+    static void *allocate(size_t bytes);
+
+    /** Release a plane allocated by allocate(). */
+    static void deallocate(void *p, size_t bytes) noexcept;
+
+    /** Pin the calling thread as the specified worker (if pinning). */
+    static void pin(unsigned worker);
+
+    /**
+     * Let each worker of a pool touch its band of a plane first.
+     * Worker i releases the pages of the i-th of pool.size() equal bands
+     * (cut at huge page boundaries with huge pages) and copies the band
+     * back. Planes not mapped on their own, and planes spread over as
+     * many workers before, are left as they are.
+     */
+    static void spread(void *p, size_t bytes, ThreadPool &pool);
+
+    /** @return placement report ("Label : value" lines) */
+    static std::string report();
+
+    /** @return true if placement differs from the defaults */
+    static bool enabled() {
+        return pages != NoHugePages || pinning != NoPinning;
+    }
+
+    /** Smallest plane mapped on its own without huge pages. */
+    static constexpr size_t min_mapped = 1 << 16;
+
+    /** Released planes kept mapped for reuse. */
+    static constexpr size_t released_planes = 64;
+
+private:
+    /// Page backing
+    static HugePages pages;
+    /// Worker pinning
+    static Pinning pinning;
+    /// Size of a huge page
+    static size_t huge_page;
+    /// Allowed cores in the order workers are pinned to
+    static std::vector<int> cores;
+    /// NUMA node of each core in cores
+    static std::vector<int> core_nodes;
+    /// Number of NUMA nodes
+    static unsigned nodes;
+
+    /** @return bytes mapped for a plane, 0 if it comes from the heap */
+    static size_t mapped_size(size_t bytes);
+};
+
+/** STL allocator of grid planes, see Placement. */
+template<typename T>
+class PlaneAllocator {
+public:
+    using value_type = T;
+
+    PlaneAllocator() = default;
+
+    template<typename U>
+    PlaneAllocator(const PlaneAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(Placement::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n) noexcept {
+        Placement::deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const PlaneAllocator<U> &) const {
+        return true;
+    }
+
+    template<typename U>
+    bool operator!=(const PlaneAllocator<U> &) const {
+        return false;
+    }
+};
+
+/// Per-cell plane of a CA.
+template<typename T>
+using Plane = std::vector<T, PlaneAllocator<T>>;
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * @file pool.cpp
+ * Work-stealing thread pool implementation.
+ */
+
+#include <algorithm>
+
+#include "pool.h"
+#include "placement.h"
+
+using namespace Evacuation;
+
+ThreadPool::ThreadPool(unsigned threads) :
+    queued{0}, unfinished{0}, next_queue{0}, stop{false}
+{
+    threads = std::max(threads, 1u);
+    for (unsigned id = 0; id < threads; id++) {
+        queues.emplace_back(new Queue);
+    }
+    for (unsigned id = 0; id < threads; id++) {
+        workers.emplace_back(&ThreadPool::work, this, id);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    work_available.notify_all();
+    for (auto &w : workers) {
+        w.join();
+    }
+}
+
+void ThreadPool::submit(Task task) {
+    submit(std::move(task), next_queue++ % queues.size());
+}
+
+void ThreadPool::submit(Task task, unsigned worker) {
+    unfinished++;
+    Queue &q = *queues[worker % queues.size()];
+    {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued++;
+    }
+    work_available.notify_one();
+}
+
+void ThreadPool::broadcast(const Task &task) {
+    std::mutex barrier;
+    std::condition_variable all_started;
+    unsigned started = 0, n = size();
+    for (unsigned w = 0; w < n; w++) {
+        submit([&](unsigned id) {
+            {
+                std::unique_lock<std::mutex> lock(barrier);
+                if (++started == n) {
+                    all_started.notify_all();
+                }
+                all_started.wait(lock, [&]{ return started == n; });
+            }
+            task(id);
+        }, w);
+    }
+    wait();
+}
+
+void ThreadPool::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this]{ return unfinished == 0; });
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+bool ThreadPool::take(unsigned id, Task &task) {
+    size_t n = queues.size();
+    for (size_t k = 0; k < n; k++) {
+        Queue &q = *queues[(id + k) % n];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.count == 0) {
+            continue;
+        }
+        // Own queue: most recently queued task, otherwise steal the
+        // oldest one
+        task = k == 0 ? q.pop_back() : q.pop_front();
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::work(unsigned id) {
+    Placement::pin(id);
+    Task task;
+    while (true) {
+        if (!take(id, task)) {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_available.wait(lock, [this]{ return stop || queued > 0; });
+            if (stop && queued == 0) {
+                return;
+            }
+            continue;
+        }
+
+        try {
+            task(id);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        task = nullptr;
+
+        if (--unfinished == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            work_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::Queue::push_back(Task task) {
+    if (count == slots.size()) {
+        // Unroll the ring into twice the slots
+        std::vector<Task> grown(std::max<size_t>(2 * slots.size(), 16));
+        for (size_t i = 0; i < count; i++) {
+            grown[i] = std::move(slots[(head + i) % slots.size()]);
+        }
+        slots.swap(grown);
+        head = 0;
+    }
+    slots[(head + count++) % slots.size()] = std::move(task);
+}
+
+ThreadPool::Task ThreadPool::Queue::pop_back() {
+    Task &slot = slots[(head + --count) % slots.size()];
+    Task task = std::move(slot);
+    slot = nullptr;
+    return task;
+}
+
+ThreadPool::Task ThreadPool::Queue::pop_front() {
+    Task &slot = slots[head];
+    Task task = std::move(slot);
+    slot = nullptr;
+    head = (head + 1) % slots.size();
+    count--;
+    return task;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file pool.h
+ * Work-stealing thread pool interface.
+ */
+
+#ifndef __pool_h
+#define __pool_h
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+
+namespace Evacuation {
+
+/**
+ * Thread pool with a task queue per worker.
+ * Submitted tasks are dealt round-robin; a worker takes its own tasks
+ * from the back of its queue and steals from the front of the others
+ * once it runs dry. Every task learns the index of the worker running
+ * it, so results can be accumulated per worker without locking.
+ */
+class ThreadPool {
+public:
+    /** Task receiving the index of the worker running it. */
+    using Task = std::function<void(unsigned worker)>;
+
+    /** @param threads number of workers (at least one) */
+    explicit ThreadPool(unsigned threads);
+
+    /** Finish the queued tasks and join the workers. */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /** @return number of workers */
+    unsigned size() const { return workers.size(); }
+
+    /** Queue a task. */
+    void submit(Task task);
+
+    /** Queue a task to the queue of the specified worker. */
+    void submit(Task task, unsigned worker);
+
+    /**
+     * Run a task once on every worker and wait until all are finished.
+     * Every copy holds its worker until all copies run, so no worker
+     * runs two; no other tasks may be pending.
+     * @throw the first exception thrown by a task
+     */
+    void broadcast(const Task &task);
+
+    /**
+     * Wait until all submitted tasks are finished.
+     * @throw the first exception thrown by a task
+     */
+    void wait();
+
+private:
+    /**
+     * Task queue of a single worker: a ring buffer grown by doubling, so
+     * queueing tasks in steady state does not allocate.
+     */
+    struct Queue {
+        std::mutex mutex;
+        /// Slots of the ring
+        std::vector<Task> slots;
+        /// Slot of the oldest task
+        size_t head = 0;
+        /// Number of queued tasks
+        size_t count = 0;
+
+        /** Queue a task as the newest one. */
+        void push_back(Task task);
+
+        /** @return newest task, removed from the queue */
+        Task pop_back();
+
+        /** @return oldest task, removed from the queue */
+        Task pop_front();
+    };
+
+    /// Queue per worker
+    std::vector<std::unique_ptr<Queue>> queues;
+    /// Workers
+    std::vector<std::thread> workers;
+    /// Guards sleeping, waiting and the first error
+    std::mutex mutex;
+    /// Signalled when a task is queued or the pool stops
+    std::condition_variable work_available;
+    /// Signalled when the last unfinished task finishes
+    std::condition_variable work_done;
+    /// Queued tasks not yet taken by a worker
+    std::atomic<size_t> queued;
+    /// Submitted tasks not yet finished
+    std::atomic<size_t> unfinished;
+    /// Queue receiving the next task
+    std::atomic<unsigned> next_queue;
+    /// Stop the workers
+    bool stop;
+    /// First exception thrown by a task
+    std::exception_ptr error;
+
+    /** Take a task: own queue first, then steal. */
+    bool take(unsigned id, Task &task);
+
+    /** Worker loop. */
+    void work(unsigned id);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ * @file random.h
+ * Pseudo-random number generator with explicit state.
+ */
+
+#ifndef __random_h
+#define __random_h
+
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+namespace Evacuation {
+
+/**
+ * xoshiro256** generator.
+ * Unlike rand(), the state is owned by the caller, so it can be
+ * checkpointed and every CA copy can have an independent stream.
+ */
+class Random {
+public:
+    using result_type = uint64_t;
+
+    /// Generator state
+    uint64_t state[4];
+
+    explicit Random(uint64_t seed = 0) {
+        this->seed(seed);
+    }
+
+    /** Reset the state from a single seed (expanded by splitmix64). */
+    void seed(uint64_t seed) {
+        for (auto &s : state) {
+            seed += 0x9e3779b97f4a7c15;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            s = z ^ (z >> 31);
+        }
+    }
+
+    /** @return next 64 random bits */
+    inline uint64_t operator()() {
+        uint64_t result = rotl(state[1] * 5, 7) * 9;
+        uint64_t t = state[1] << 17;
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = rotl(state[3], 45);
+        return result;
+    }
+
+    static constexpr uint64_t min() { return 0; }
+    static constexpr uint64_t max() { return UINT64_MAX; }
+
+    /** @return uniformly distributed number from [0, 1) */
+    inline double uniform() {
+        return ((*this)() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /** @return uniformly distributed integer from [0, n) */
+    inline size_t below(size_t n) {
+        return uniform() * n;
+    }
+
+    /** Random permutation of a vector (Fisher-Yates). */
+    template<class Vector>
+    void shuffle(Vector &vec) {
+        for (size_t i = vec.size(); i > 1; i--) {
+            std::swap(vec[i - 1], vec[below(i)]);
+        }
+    }
+
+private:
+    static inline uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,212 @@
+/**
+ * @file runner.cpp
+ * Replicate runner implementation.
+ */
+
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <cmath>
+#include <sstream>
+
+#include <unistd.h>
+
+#include "runner.h"
+#include "bitmap.h"
+#include "domain.h"
+
+using namespace Evacuation;
+
+Runner::Runner(const CA &model, const RunOptions &options) :
+    model(model), options{options}
+{
+    // Bands live in worker processes, there is no CA to store
+    if (options.domains > 1 && !options.checkpoint.empty()) {
+        throw std::invalid_argument("cannot checkpoint a run over domains");
+    }
+    if (this->options.threads == 0) {
+        this->options.threads = 1;
+    }
+    // Keep every worker busy within a batch
+    unsigned threads = this->options.threads;
+    unsigned batch = std::max(this->options.batch, 1u);
+    this->options.batch = (batch + threads - 1) / threads * threads;
+}
+
+Statistics Runner::replicate(unsigned index) {
+    // Copy the CA
+    CA ca = model.copy();
+    if (options.params != nullptr) {
+        ca.set_params(*options.params);
+    }
+
+    if (options.reseed) {
+        // Independent stream for each run
+        ca.seed(options.seed + index);
+    }
+    if (options.populate) {
+        // Populate the CA
+        ca.add_people(options.people);
+        ca.add_smoke(options.smoke);
+    }
+
+    if (options.domains > 1) {
+        // Worker processes evolve the bands, see Domain
+        return Domain::run(ca, options.domains);
+    }
+
+    // Block exits scheduled for the current step
+    auto block = [&]() {
+        for (auto &b : options.blocked_exits) {
+            if (ca.stat.time == b.second) {
+                ca.disable_exit(b.first);
+            }
+        }
+    };
+
+    // Heap allocations of each step, the first one warming up
+    Profile profile;
+    uint64_t before = allocations();
+    auto count = [&]() {
+        uint64_t now = allocations(), n = now - before;
+        if (profile.steps++ == 0) {
+            profile.first_allocations += n;
+        }
+        else {
+            profile.allocations += n;
+            profile.max_allocations = std::max(profile.max_allocations, n);
+        }
+        before = now;
+    };
+
+    // Evolve CA in loop until CA can't change its states
+    long delay = options.delay;
+    block();
+    while (ca.evolve()) {
+        if (options.profile) {
+            count();
+        }
+        block();
+        if (index == 0 && ca.stat.time == options.checkpoint_step) {
+            ca.checkpoint(options.checkpoint);
+        }
+        if (delay > 0) {
+            // Show the current state of CA
+            Bitmap::display_distances(ca);
+            ca.show();
+            usleep(delay);
+        }
+    }
+    if (delay > 0) {
+        // Show the final state of CA
+        ca.show();
+    }
+
+    if (options.profile) {
+        count();
+        std::lock_guard<std::mutex> lock(mutex);
+        totals.steps += profile.steps;
+        totals.first_allocations += profile.first_allocations;
+        totals.allocations += profile.allocations;
+        totals.max_allocations =
+            std::max(totals.max_allocations, profile.max_allocations);
+    }
+    return ca.stat;
+}
+
+Profile Runner::profile() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return totals;
+}
+
+std::string Profile::str() const {
+    std::ostringstream out;
+    out << "Steps                              : " << steps << "\n"
+        << "Allocations in first steps         : " << first_allocations
+        << "\n"
+        << "Allocations in later steps         : " << allocations
+        << " (max " << max_allocations << " per step)\n";
+    return out.str();
+}
+
+void Runner::run(unsigned first, unsigned count, Statistics &stat) {
+    // Displayed and decomposed runs are sequential
+    unsigned threads =
+        options.delay > 0 || options.domains > 1 ? 1 : options.threads;
+    threads = std::max(1u, std::min(threads, count));
+
+    std::vector<Statistics> partial(threads);
+    std::vector<std::exception_ptr> errors(threads);
+    std::atomic<unsigned> next(first);
+    auto worker = [&](unsigned id) {
+        if (threads > 1) {
+            Placement::pin(id);
+        }
+        try {
+            unsigned i;
+            while ((i = next++) < first + count) {
+                Statistics s = replicate(i);
+                partial[id].aggregate(s);
+            }
+        }
+        catch (...) {
+            // Rethrown in the calling thread
+            errors[id] = std::current_exception();
+            next = first + count;
+        }
+    };
+
+    if (threads == 1) {
+        worker(0);
+    }
+    else {
+        std::vector<std::thread> pool;
+        for (unsigned id = 0; id < threads; id++) {
+            pool.emplace_back(worker, id);
+        }
+        for (auto &t : pool) {
+            t.join();
+        }
+    }
+
+    for (auto &e : errors) {
+        if (e) {
+            std::rethrow_exception(e);
+        }
+    }
+
+    // Merge in a fixed order
+    for (auto &p : partial) {
+        stat.merge(p);
+    }
+}
+
+bool Runner::precise(const Statistics &stat) const {
+    // Too few runs for a meaningful variance estimate
+    constexpr unsigned min_runs = 10;
+    if (stat.runs() < min_runs) {
+        return false;
+    }
+    const Accumulator &acc = stat.metrics[options.target_metric];
+    return acc.ci() <= options.target_width * std::abs(acc.mean());
+}
+
+unsigned Runner::run_until(unsigned max_runs, Statistics &stat) {
+    if (options.target_metric == Statistics::Metrics) {
+        run(0, max_runs, stat);
+        return max_runs;
+    }
+
+    unsigned done = 0;
+    while (done < max_runs) {
+        unsigned count = std::min(options.batch, max_runs - done);
+        run(done, count, stat);
+        done += count;
+        if (precise(stat)) {
+            break;
+        }
+    }
+    return done;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file runner.h
+ * Replicate runner interface.
+ */
+
+#ifndef __runner_h
+#define __runner_h
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+#include "evacuation.h"
+
+namespace Evacuation {
+
+/** Replicate options. */
+struct RunOptions {
+    /** Number of people to evacuate. */
+    int people = 100;
+    /** Number of cells with smoke. */
+    int smoke = 0;
+    /** Seed of the first replicate; replicate i is seeded with seed + i. */
+    uint64_t seed = 0;
+    /** Populate copies of the model with people and smoke. */
+    bool populate = true;
+    /** Reseed copies of the model. */
+    bool reseed = true;
+    /** Delay of displayed steps in microseconds (0 = no display). */
+    long delay = 0;
+    /** Step at which the first replicate is checkpointed (-1 = never). */
+    double checkpoint_step = -1;
+    /** Checkpoint output file. */
+    std::string checkpoint;
+    /** Number of worker threads. */
+    unsigned threads = 1;
+    /** Parameters replacing those of the model (nullptr = keep). */
+    const ModelParams *params = nullptr;
+    /** Metric whose confidence interval stops the replicates. */
+    Statistics::Metric target_metric = Statistics::Metrics;
+    /** Target relative half-width of the 95 % confidence interval. */
+    double target_width = 0.0;
+    /** Replicates run between two precision checks. */
+    unsigned batch = 10;
+    /** Row bands evolved by separate processes (1 = no decomposition). */
+    unsigned domains = 1;
+    /** Exits blocked during the replicates as (exit, step) pairs. */
+    std::vector<std::pair<unsigned, double>> blocked_exits;
+    /** Count heap allocations of the steps, see Runner::profile(). */
+    bool profile = false;
+};
+
+/** Heap allocations of the steps of replicates. */
+struct Profile {
+    /** Steps evolved. */
+    uint64_t steps = 0;
+    /** Allocations in the first steps of replicates (warm-up). */
+    uint64_t first_allocations = 0;
+    /** Allocations in the other steps. */
+    uint64_t allocations = 0;
+    /** Most allocations in one of the other steps. */
+    uint64_t max_allocations = 0;
+
+    /** String representation of the profile. */
+    std::string str() const;
+};
+
+/**
+ * Runs replicates of a model.
+ * Every worker thread aggregates into its own statistics, which are
+ * merged once the workers join, so no state is shared while running.
+ */
+class Runner {
+public:
+    /**
+     * @param model template copied by every replicate
+     * @param options replicate options
+     * @throw invalid_argument if a checkpoint is requested with domains
+     */
+    Runner(const CA &model, const RunOptions &options);
+
+    /**
+     * Run replicates [first, first + count) and aggregate them.
+     * @param stat statistics to aggregate into
+     */
+    void run(unsigned first, unsigned count, Statistics &stat);
+
+    /**
+     * Run replicates in batches until the confidence interval of the
+     * target metric is narrow enough (see RunOptions::target_width).
+     * Without a target metric, all replicates are run.
+     * @param max_runs maximum number of replicates
+     * @param stat statistics to aggregate into
+     * @return number of replicates run
+     */
+    unsigned run_until(unsigned max_runs, Statistics &stat);
+
+    /**
+     * Run a single replicate.
+     * @param index index of the replicate
+     * @return statistics of the replicate
+     */
+    Statistics replicate(unsigned index);
+
+    /** @return allocation profile of the replicates run so far */
+    Profile profile() const;
+
+private:
+    /// Template model
+    const CA &model;
+    /// Replicate options
+    RunOptions options;
+    /// Guards the profile
+    mutable std::mutex mutex;
+    /// Allocation profile (with RunOptions::profile)
+    Profile totals;
+
+    /** @return true if the target precision is met */
+    bool precise(const Statistics &stat) const;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,318 @@
+/**
+ * @file server.cpp
+ * Simulation job server implementation.
+ */
+
+#include <sstream>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <cstring>
+#include <cmath>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "runner.h"
+
+using namespace Evacuation;
+
+template<typename Value>
+Value *Server::Lru<Value>::get(const std::string &key) {
+    auto it = index.find(key);
+    if (it == index.end()) {
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, it->second);
+    return &it->second->second;
+}
+
+template<typename Value>
+void Server::Lru<Value>::put(const std::string &key, Value value) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+        entries.erase(it->second);
+        index.erase(it);
+    }
+    entries.emplace_front(key, std::move(value));
+    index[key] = entries.begin();
+    while (entries.size() > capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+}
+
+Server::Server(
+    const std::string &path, unsigned threads, size_t models, size_t results
+) :
+    path{path}, listener{-1}, bound{false}, pool(threads), models(models), results(results)
+{}
+
+/** @return true if a path names a socket (not following links) */
+static bool is_socket(const std::string &path) {
+    struct stat st;
+    return lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode);
+}
+
+Server::~Server() {
+    if (listener >= 0) {
+        close(listener);
+    }
+    if (bound && is_socket(path)) {
+        unlink(path.c_str());
+    }
+}
+
+std::string Server::hash_file(const std::string &filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) < 0) {
+        throw std::invalid_argument("could not open input file");
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = hashes.find(filename);
+        if (it != hashes.end() && it->second.mtime == st.st_mtime &&
+            it->second.size == st.st_size)
+        {
+            return it->second.hash;
+        }
+    }
+
+    // FNV-1a over the content
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        throw std::invalid_argument("could not open input file");
+    }
+    uint64_t h = 0xcbf29ce484222325;
+    char buffer[1 << 16];
+    while (in.read(buffer, sizeof(buffer)) || in.gcount() > 0) {
+        for (std::streamsize i = 0; i < in.gcount(); i++) {
+            h = (h ^ (unsigned char) buffer[i]) * 0x100000001b3;
+        }
+    }
+    std::ostringstream hex;
+    hex << std::hex << std::setw(16) << std::setfill('0') << h;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    hashes[filename] = FileHash{st.st_mtime, st.st_size, hex.str()};
+    return hex.str();
+}
+
+std::string Server::handle(const std::string &request) {
+    try {
+        // Parse the job
+        RunOptions options;
+        ModelParams params;
+        unsigned runs = 1;
+        std::string map, hash;
+        std::istringstream in(request);
+        std::string token;
+        while (in >> token) {
+            size_t eq = token.find('=');
+            if (eq == std::string::npos) {
+                throw std::invalid_argument("expected key=value");
+            }
+            std::string key = token.substr(0, eq);
+            std::string value = token.substr(eq + 1);
+            if (key == "map") {
+                map = value;
+            }
+            else if (key == "hash") {
+                hash = value;
+            }
+            else if (key == "people") {
+                options.people = std::stoi(value);
+            }
+            else if (key == "smoke") {
+                options.smoke = std::stoi(value);
+            }
+            else if (key == "runs") {
+                runs = std::stoul(value);
+            }
+            else if (key == "seed") {
+                options.seed = std::stoull(value);
+            }
+            else {
+                params.set(token);
+            }
+        }
+        if (!map.empty()) {
+            hash = hash_file(map);
+        }
+        if (hash.empty()) {
+            throw std::invalid_argument("no map");
+        }
+        if (runs == 0) {
+            throw std::invalid_argument("no runs");
+        }
+
+        // Memoised response
+        std::ostringstream key;
+        key << std::setprecision(9) << hash << " " << options.people << " "
+            << options.smoke << " " << options.seed << " " << runs;
+        for (size_t i = 0; i < ModelParams::count; i++) {
+            key << " " << params.at(i);
+        }
+        std::string prefix =
+            "ok runs=" + std::to_string(runs) + " hash=" + hash;
+        std::shared_ptr<const CA> model;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (std::string *cached = results.get(key.str())) {
+                return prefix + " cached=1" + *cached;
+            }
+            if (auto *m = models.get(hash)) {
+                model = *m;
+            }
+        }
+
+        // Load the model and its static field
+        if (!model) {
+            if (map.empty()) {
+                throw std::invalid_argument("unknown map hash " + hash);
+            }
+            model = std::make_shared<const CA>(CA::load(map));
+            std::lock_guard<std::mutex> lock(mutex);
+            models.put(hash, model);
+        }
+
+        // Replicates on the shared pool
+        options.params = &params;
+        Runner runner(*model, options);
+        std::vector<Statistics> replicates(runs);
+        std::mutex done_mutex;
+        std::condition_variable done;
+        unsigned remaining = runs;
+        std::exception_ptr error;
+        for (unsigned r = 0; r < runs; r++) {
+            pool.submit([&, r](unsigned) {
+                std::exception_ptr e;
+                try {
+                    replicates[r] = runner.replicate(r);
+                }
+                catch (...) {
+                    e = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(done_mutex);
+                if (e && !error) {
+                    error = e;
+                }
+                if (--remaining == 0) {
+                    done.notify_one();
+                }
+            });
+        }
+        {
+            std::unique_lock<std::mutex> lock(done_mutex);
+            done.wait(lock, [&remaining]{ return remaining == 0; });
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
+        Statistics stat;
+        for (auto &s : replicates) {
+            stat.aggregate(s);
+        }
+        std::ostringstream metrics;
+        for (int m = 0; m < Statistics::Metrics; m++) {
+            const Accumulator &acc = stat.metrics[m];
+            metrics << " " << Statistics::metric_names[m] << "=" << acc.mean()
+                << " " << Statistics::metric_names[m] << "_ci=";
+            if (std::isnan(acc.ci())) {
+                metrics << "n/a";
+            }
+            else {
+                metrics << acc.ci();
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            results.put(key.str(), metrics.str());
+        }
+        return prefix + " cached=0" + metrics.str();
+    }
+    catch (std::exception &e) {
+        return std::string("error ") + e.what();
+    }
+}
+
+void Server::converse(int fd) {
+    std::string pending;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        pending.append(buffer, n);
+        size_t nl;
+        while ((nl = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, nl);
+            pending.erase(0, nl + 1);
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            std::string response = handle(line) + "\n";
+            size_t sent = 0;
+            while (sent < response.size()) {
+                ssize_t k = send(fd, response.data() + sent,
+                    response.size() - sent, MSG_NOSIGNAL);
+                if (k <= 0) {
+                    close(fd);
+                    return;
+                }
+                sent += k;
+            }
+        }
+    }
+    close(fd);
+}
+
+void Server::serve() {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("socket path too long");
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        throw std::runtime_error("could not create socket");
+    }
+
+    // Only a stale socket is replaced
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            throw std::runtime_error("path exists: " + path);
+        }
+        unlink(path.c_str());
+    }
+    if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+    {
+        throw std::runtime_error("could not listen on " + path);
+    }
+    bound = true;
+    if (listen(listener, 64) < 0) {
+        throw std::runtime_error("could not listen on " + path);
+    }
+
+    // Connections are served concurrently; their jobs share the pool
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw std::runtime_error("could not accept connection");
+        }
+        std::thread(&Server::converse, this, fd).detach();
+    }
+}
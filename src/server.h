@@ -0,0 +1,130 @@
+/**
+ * @file server.h
+ * Simulation job server interface.
+ */
+
+#ifndef __server_h
+#define __server_h
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+
+#include "evacuation.h"
+#include "pool.h"
+
+namespace Evacuation {
+
+/**
+ * Long-running server of simulation jobs on a Unix domain socket.
+ *
+ * A client sends one job per line as space separated key=value pairs
+ * and receives one line per job:
+ *
+ *   map=experiments/D1.bmp people=200 smoke=5 runs=20 seed=1 chaos_rate=0.1
+ *   ok runs=20 cached=0 time=108.4 time_ci=1.9 smoke=... max_smoke_ci=...
+ *
+ * Keys: map (path of a bitmap or native map) or hash (of a map loaded
+ * before, as returned by earlier responses), people, smoke, runs, seed
+ * and every ModelParams member. Metrics are means and 95 % CI
+ * half-widths (n/a for a single run) in steps and cells, as in the
+ * sweep table. Failed jobs get "error <message>".
+ *
+ * Loaded models (with their static exit field) are kept in an LRU cache
+ * keyed by a hash of the map file, and responses are memoised by
+ * (map hash, people, smoke, params, seed, runs), so a repeated job is
+ * answered without running. Replicates of all jobs share one
+ * work-stealing pool.
+ */
+class Server {
+public:
+    /**
+     * @param path path of the socket (replaced if it exists)
+     * @param threads number of worker threads
+     * @param models capacity of the model cache
+     * @param results capacity of the result cache
+     */
+    Server(const std::string &path, unsigned threads, size_t models = 8,
+        size_t results = 4096);
+    ~Server();
+
+    Server(const Server &) = delete;
+    Server &operator=(const Server &) = delete;
+
+    /**
+     * Accept connections until the process is terminated. A socket left
+     * at the path by an earlier server is replaced; any other file is
+     * kept.
+     * @throw runtime_error if the socket could not be set up or the path
+     * exists and is not a socket
+     */
+    void serve();
+
+    /** @return response to a single job line */
+    std::string handle(const std::string &request);
+
+private:
+    /** Least recently used cache. */
+    template<typename Value>
+    class Lru {
+    public:
+        explicit Lru(size_t capacity) : capacity{capacity} {}
+
+        /** @return cached value or nullptr; marks it recently used */
+        Value *get(const std::string &key);
+
+        /** Insert a value, evicting the least recently used one. */
+        void put(const std::string &key, Value value);
+
+    private:
+        using Entry = std::pair<std::string, Value>;
+        /// Maximum number of entries
+        size_t capacity;
+        /// Entries, most recently used first
+        std::list<Entry> entries;
+        /// Entries by key
+        std::unordered_map<std::string,
+            typename std::list<Entry>::iterator> index;
+    };
+
+    /** Hash of a map file. */
+    struct FileHash {
+        /// Modification time and size the hash was computed for
+        int64_t mtime, size;
+        /// FNV-1a hash of the content
+        std::string hash;
+    };
+
+    /// Path of the socket
+    std::string path;
+    /// Listening socket
+    int listener;
+    /// The socket file at path was created by the server
+    bool bound;
+    /// Workers running replicates of all jobs
+    ThreadPool pool;
+    /// Guards the caches
+    std::mutex mutex;
+    /// Hashes of map files by path
+    std::unordered_map<std::string, FileHash> hashes;
+    /// Loaded models by map hash
+    Lru<std::shared_ptr<const CA>> models;
+    /// Responses by job key
+    Lru<std::string> results;
+
+    /**
+     * @return hash of a map file
+     * @throw invalid_argument if the file cannot be read
+     */
+    std::string hash_file(const std::string &filename);
+
+    /** Serve a connection until the client closes it. */
+    void converse(int fd);
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,174 @@
+/**
+ * @file smoke.cpp
+ * Smoke spreading apart from the people implementation.
+ */
+
+#include <stdexcept>
+
+#include "smoke.h"
+
+using namespace Evacuation;
+
+SmokePlane::SmokePlane(const CA &ca, Random random, bool ahead) :
+    height{ca.height}, width{ca.width}, random{random},
+    rate{ca.params().smoke_spreading_rate}, logged{0},
+    taken{(unsigned) ca.stat.time}, consumed{0}, head{0}, queued{0}, finished{false},
+    stop{false}
+{
+    size_t stride = width + 2;
+    state.assign((height + 2) * stride, Closed);
+    neighbours.assign(state.size(), 0);
+    smoky.assign(state.size(), 0);
+    size_t open = 0;
+    for (size_t row = 0; row < height; row++) {
+        for (size_t col = 0; col < width; col++) {
+            size_t f = (row + 1) * stride + col + 1;
+            CellType type = ca.cell(row, col).type;
+            if (type & SmokeCells) {
+                state[f] = Smoked;
+            }
+            else if (!(type & (Exit | PersonAtExit | Wall))) {
+                state[f] = Open;
+                open++;
+            }
+        }
+    }
+
+    // Open cells join the frontier and catch smoke at most once
+    frontier.reserve(open);
+    log.reset(new CellPosition[open]);
+
+    // Neighbour counts and the initial frontier
+    const long around[8] = {
+        -(long) stride - 1, -(long) stride, -(long) stride + 1, -1, 1,
+        (long) stride - 1, (long) stride, (long) stride + 1
+    };
+    for (size_t f = stride; f < state.size() - stride; f++) {
+        if (state[f] == Closed) {
+            continue;
+        }
+        for (long d : around) {
+            neighbours[f] += state[f + d] != Closed;
+            smoky[f] += state[f + d] == Smoked;
+        }
+        if (state[f] == Open && smoky[f] > 0) {
+            frontier.push_back(f);
+        }
+    }
+
+    if (ahead) {
+        worker = std::thread(&SmokePlane::work, this);
+    }
+}
+
+SmokePlane::~SmokePlane() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        changed.notify_all();
+        worker.join();
+    }
+}
+
+bool SmokePlane::advance() {
+    if (frontier.empty()) {
+        return false;
+    }
+
+    // Every frontier cell draws against the smoke at the start of the
+    // step (see CA::evolve_step())
+    size_t stride = width + 2;
+    size_t first = logged, kept = 0;
+    for (uint32_t f : frontier) {
+        float smoke_neigh = smoky[f];
+        float neigh = neighbours[f];
+        if (smoke_neigh / neigh * rate > random.uniform()) {
+            state[f] = Smoked;
+            log[logged++] = CellPosition(f / stride - 1, f % stride - 1);
+        }
+        else {
+            frontier[kept++] = f;
+        }
+    }
+    frontier.resize(kept);
+
+    // Open neighbours of the new smoke join the frontier
+    const long around[8] = {
+        -(long) stride - 1, -(long) stride, -(long) stride + 1, -1, 1,
+        (long) stride - 1, (long) stride, (long) stride + 1
+    };
+    for (size_t i = first; i < logged; i++) {
+        size_t row = log[i].first, col = log[i].second;
+        size_t f = (row + 1) * stride + col + 1;
+        for (long d : around) {
+            if (++smoky[f + d] == 1 && state[f + d] == Open) {
+                frontier.push_back(f + d);
+            }
+        }
+    }
+    return true;
+}
+
+void SmokePlane::arrivals(unsigned step, People &cells) {
+    if (step != taken + 1) {
+        throw std::logic_error("smoke steps taken out of order");
+    }
+    taken = step;
+
+    // Computing lazily
+    size_t end;
+    if (!worker.joinable()) {
+        if (!finished) {
+            finished = !advance();
+        }
+        end = logged;
+    }
+    // Computed ahead; the thread publishes log ends through the ring only
+    else {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]{ return queued > 0 || finished; });
+            if (queued == 0) {
+                return;
+            }
+            end = ends[head];
+            head = (head + 1) % lookahead;
+            queued--;
+        }
+        changed.notify_all();
+    }
+    cells.insert(cells.end(), log.get() + consumed, log.get() + end);
+    consumed = end;
+}
+
+void SmokePlane::work() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this]{
+                return stop || queued < lookahead;
+            });
+            if (stop) {
+                return;
+            }
+        }
+        // The CA only reads log entries of steps in the ring
+        bool spreading = advance();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (spreading) {
+                ends[(head + queued) % lookahead] = logged;
+                queued++;
+            }
+            else {
+                finished = true;
+            }
+        }
+        changed.notify_all();
+        if (!spreading) {
+            return;
+        }
+    }
+}
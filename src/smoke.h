@@ -0,0 +1,133 @@
+/**
+ * @file smoke.h
+ * Smoke spreading apart from the people interface.
+ */
+
+#ifndef __smoke_h
+#define __smoke_h
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "evacuation.h"
+
+namespace Evacuation {
+
+/**
+ * Smoke spreading simulated apart from the people.
+ *
+ * Smoke coverage does not depend on where people are: a person entering
+ * smoke becomes PersonWithSmoke, which is a SmokeCells type, and leaves
+ * Smoke behind. The plane replays the spreading rule of CA::evolve() on
+ * its own copy of the grid, with its own random stream: every step, a
+ * cell that may catch smoke does so with probability smoke neighbours /
+ * neighbours other than exits and walls * smoke_spreading_rate. Only
+ * the frontier (cells that may catch smoke next to smoke) is visited.
+ * Exits count as exits even while people stand in them, so unlike the
+ * inline rule, evacuating people do not change the odds next to exits.
+ *
+ * The cells catching smoke are appended to an arrival log, step by step,
+ * and handed to the CA, which turns them into smoke after solving the
+ * exit field, where the inline rule does. Every open cell catches smoke
+ * at most once, so the log is reserved up front and steps allocate
+ * nothing. Steps are computed lazily, when the CA asks for them, or
+ * ahead by a thread of their own, at most lookahead steps in advance.
+ * Both give the same arrivals.
+ */
+class SmokePlane {
+public:
+    /// Steps the thread may compute in advance of the CA
+    static constexpr unsigned lookahead = 64;
+
+    /**
+     * Take the smoke of a CA.
+     * @param ca automaton whose smoke spreads
+     * @param random random stream of the spreading
+     * @param ahead compute steps on a thread of their own
+     */
+    SmokePlane(const CA &ca, Random random, bool ahead);
+
+    /** Stop the thread computing ahead. */
+    ~SmokePlane();
+
+    SmokePlane(const SmokePlane &) = delete;
+    SmokePlane &operator=(const SmokePlane &) = delete;
+
+    /**
+     * Append the cells catching smoke at a step (waiting for the thread
+     * to compute it). Steps are taken one at a time, in order, starting
+     * with the step after the one the plane was taken at.
+     */
+    void arrivals(unsigned step, People &cells);
+
+private:
+    /** Smoke state of a cell. */
+    enum State : uint8_t {
+        /// Exit or wall, not a neighbour
+        Closed,
+        /// May catch smoke
+        Open,
+        /// Smoke
+        Smoked
+    };
+
+    /// Grid size
+    size_t height, width;
+    /// Row-major states framed by closed cells (width + 2 per row)
+    std::vector<State> state;
+    /// Neighbours other than exits and walls by framed index
+    std::vector<uint8_t> neighbours;
+    /// Smoke neighbours by framed index
+    std::vector<uint8_t> smoky;
+    /// Open cells next to smoke (framed indices)
+    std::vector<uint32_t> frontier;
+    /// Random stream of the spreading
+    Random random;
+    /// Probability factor
+    float rate;
+    /// Arrivals of the steps computed so far, in order (room for every
+    /// open cell); the CA reads entries of the steps taken only
+    std::unique_ptr<CellPosition[]> log;
+    /// Log entries written (by the thread computing ahead, if any)
+    size_t logged;
+
+    /// Last step taken by the CA (at first, the step the plane was taken at)
+    unsigned taken;
+    /// Arrivals handed to the CA (log entries)
+    size_t consumed;
+
+    /// Guards the ring and the flags below
+    std::mutex mutex;
+    /// Signalled when a step is queued or taken, or the thread stops
+    std::condition_variable changed;
+    /// Log ends of the steps computed ahead and not taken yet (ring)
+    size_t ends[lookahead];
+    /// First step of the ring
+    unsigned head;
+    /// Steps in the ring
+    unsigned queued;
+    /// Smoke cannot spread any further
+    bool finished;
+    /// Stop the thread
+    bool stop;
+    /// Thread computing ahead (if any)
+    std::thread worker;
+
+    /**
+     * Compute the step following the one computed last, appending the
+     * cells catching smoke at the step to the log.
+     * @return false if smoke cannot spread any further
+     */
+    bool advance();
+
+    /** Loop of the thread computing ahead. */
+    void work();
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,206 @@
+/**
+ * @file sweep.cpp
+ * Parameter sweep implementation.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <stdexcept>
+#include <algorithm>
+
+#include "sweep.h"
+#include "runner.h"
+#include "pool.h"
+
+using namespace Evacuation;
+
+Sweep::Sweep() {
+    // Every parameter keeps its default unless swept
+    ModelParams defaults;
+    for (size_t i = 0; i < ModelParams::count; i++) {
+        params.push_back({defaults.at(i)});
+    }
+}
+
+/** Split a value list on whitespace and commas. */
+static std::vector<std::string> split(const std::string &values) {
+    std::string s = values;
+    std::replace(s.begin(), s.end(), ',', ' ');
+    std::istringstream in(s);
+    std::vector<std::string> res;
+    std::string item;
+    while (in >> item) {
+        res.push_back(item);
+    }
+    return res;
+}
+
+Sweep Sweep::parse(std::istream &in) {
+    Sweep sweep;
+    std::string line;
+    unsigned lineno = 0;
+    while (std::getline(in, line)) {
+        lineno++;
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        std::string where = "sweep specification line " +
+            std::to_string(lineno);
+        if (eq == std::string::npos) {
+            throw std::invalid_argument(where + ": expected key = value");
+        }
+        std::istringstream keyin(line.substr(0, eq));
+        std::string key;
+        keyin >> key;
+        auto values = split(line.substr(eq + 1));
+        if (values.empty()) {
+            throw std::invalid_argument(where + ": no value");
+        }
+
+        try {
+            if (key == "map") {
+                sweep.maps = values;
+            }
+            else if (key == "people" || key == "smoke") {
+                auto &dst = key == "people" ? sweep.people : sweep.smoke;
+                dst.clear();
+                for (auto &v : values) {
+                    dst.push_back(std::stoi(v));
+                }
+            }
+            else if (key == "runs") {
+                sweep.runs = std::stoul(values.at(0));
+            }
+            else if (key == "seed") {
+                sweep.seed = std::stoull(values.at(0));
+            }
+            else {
+                auto &dst = sweep.params[ModelParams::index(key)];
+                dst.clear();
+                for (auto &v : values) {
+                    dst.push_back(std::stof(v));
+                }
+            }
+        }
+        catch (std::invalid_argument &e) {
+            throw std::invalid_argument(where + ": " + e.what());
+        }
+        catch (std::out_of_range &) {
+            throw std::invalid_argument(where + ": value out of range");
+        }
+    }
+
+    if (sweep.maps.empty()) {
+        throw std::invalid_argument("sweep specification has no map");
+    }
+    return sweep;
+}
+
+Sweep Sweep::load(const std::string &filename) {
+    std::ifstream in(filename);
+    if (!in) {
+        throw std::invalid_argument("could not open sweep specification");
+    }
+    return parse(in);
+}
+
+std::vector<Sweep::Scenario> Sweep::expand() const {
+    std::vector<Scenario> res;
+    Scenario base;
+    for (size_t m = 0; m < maps.size(); m++) {
+        base.map = m;
+        for (int p : people) {
+            base.people = p;
+            for (int s : smoke) {
+                base.smoke = s;
+                res.push_back(base);
+            }
+        }
+    }
+
+    // Expand one parameter at a time
+    for (size_t i = 0; i < ModelParams::count; i++) {
+        std::vector<Scenario> next;
+        for (auto &sc : res) {
+            for (float v : params[i]) {
+                next.push_back(sc);
+                next.back().params.at(i) = v;
+            }
+        }
+        res.swap(next);
+    }
+    return res;
+}
+
+size_t Sweep::scenarios() const {
+    size_t n = maps.size() * people.size() * smoke.size();
+    for (auto &p : params) {
+        n *= p.size();
+    }
+    return n;
+}
+
+void Sweep::run(std::ostream &out, unsigned threads) {
+    // Load every map once
+    std::vector<std::unique_ptr<CA>> models;
+    for (auto &m : maps) {
+        models.emplace_back(new CA(CA::load(m)));
+    }
+
+    // Runner per scenario sharing the loaded models
+    std::vector<Scenario> all = expand();
+    std::vector<std::unique_ptr<Runner>> runners;
+    for (auto &sc : all) {
+        RunOptions options;
+        options.people = sc.people;
+        options.smoke = sc.smoke;
+        options.seed = seed;
+        options.params = &sc.params;
+        runners.emplace_back(new Runner(*models[sc.map], options));
+    }
+
+    // Each work item writes its own slot
+    std::vector<Statistics> results(all.size() * runs);
+    {
+        ThreadPool pool(threads);
+        for (size_t sc = 0; sc < all.size(); sc++) {
+            for (unsigned r = 0; r < runs; r++) {
+                pool.submit([&, sc, r](unsigned) {
+                    results[sc * runs + r] = runners[sc]->replicate(r);
+                });
+            }
+        }
+        pool.wait();
+    }
+
+    // Tidy table: one row per replicate
+    out << "scenario,map,people,smoke";
+    for (size_t i = 0; i < ModelParams::count; i++) {
+        out << "," << ModelParams::names[i];
+    }
+    out << ",replicate,seed";
+    for (int m = 0; m < Statistics::Metrics; m++) {
+        out << "," << Statistics::metric_names[m];
+    }
+    out << ",stranded\n";
+    for (size_t sc = 0; sc < all.size(); sc++) {
+        for (unsigned r = 0; r < runs; r++) {
+            const Scenario &s = all[sc];
+            const Statistics &st = results[sc * runs + r];
+            out << sc << "," << maps[s.map] << "," << s.people << ","
+                << s.smoke;
+            for (size_t i = 0; i < ModelParams::count; i++) {
+                out << "," << s.params.at(i);
+            }
+            out << "," << r << "," << seed + r;
+            for (int m = 0; m < Statistics::Metrics; m++) {
+                out << "," << st.value((Statistics::Metric) m);
+            }
+            out << "," << st.stranded << "\n";
+        }
+    }
+}
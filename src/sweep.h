@@ -0,0 +1,100 @@
+/**
+ * @file sweep.h
+ * Parameter sweep interface.
+ */
+
+#ifndef __sweep_h
+#define __sweep_h
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdint>
+
+#include "evacuation.h"
+
+namespace Evacuation {
+
+/**
+ * Declarative parameter sweep.
+ *
+ * The specification consists of "key = value ..." lines (values are
+ * separated by whitespace or commas, '#' starts a comment). Keys with
+ * several values span the sweep; scenarios are the cartesian product of
+ * all of them:
+ *
+ *   map = experiments/D1.bmp experiments/E1.bmp
+ *   people = 200 350
+ *   smoke = 0 5
+ *   chaos_rate = 0.1, 0.25
+ *   runs = 100
+ *   seed = 1
+ *
+ * Swept keys: map, people, smoke and every ModelParams member
+ * (time_step, cell_width, chaos_rate, smoke_spreading_rate,
+ * occupied_distance, smoke_distance, friction). Scalar keys: runs, seed.
+ *
+ * Each map is loaded once. All (scenario, replicate) pairs are run on a
+ * work-stealing pool, and replicate i of every scenario uses seed + i
+ * (common random numbers across scenarios). Each row ends with the
+ * people the replicate left stranded (see CA::evolve()).
+ */
+class Sweep {
+public:
+    /**
+     * Parse a sweep specification.
+     * @throw invalid_argument if the specification is malformed
+     */
+    static Sweep parse(std::istream &in);
+
+    /**
+     * Load a sweep specification from a file.
+     * @throw invalid_argument if failed to process the file
+     */
+    static Sweep load(const std::string &filename);
+
+    /**
+     * Run all scenarios and write one CSV row per replicate.
+     * @param out output stream of the results table
+     * @param threads number of worker threads
+     */
+    void run(std::ostream &out, unsigned threads);
+
+    /** @return number of scenarios */
+    size_t scenarios() const;
+
+private:
+    /** Single point of the sweep. */
+    struct Scenario {
+        /// Index of the map
+        size_t map;
+        /// Number of people
+        int people;
+        /// Number of cells with smoke
+        int smoke;
+        /// Model parameters
+        ModelParams params;
+    };
+
+    /// Input maps
+    std::vector<std::string> maps;
+    /// Swept numbers of people
+    std::vector<int> people{100};
+    /// Swept numbers of smoke cells
+    std::vector<int> smoke{0};
+    /// Swept model parameters (by ModelParams member)
+    std::vector<std::vector<float>> params;
+    /// Replicates per scenario
+    unsigned runs = 1;
+    /// Seed of the first replicate
+    uint64_t seed = 0;
+
+    Sweep();
+
+    /** @return all scenarios of the sweep */
+    std::vector<Scenario> expand() const;
+};
+
+} // end of namespace
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * @file wavefront.cpp
+ * Bit-parallel static exit field implementation.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#include "wavefront.h"
+
+using namespace Evacuation;
+
+bool Wavefront::solve(CA &ca) {
+    if (ca.smoke_count > 0) {
+        return false;
+    }
+
+    // Row-major planes framed by a blank word on every side, so words
+    // next to a wave are never out of the plane
+    size_t stride = (ca.width + 63) / 64 + 2;
+    size_t plane = (ca.height + 2) * stride;
+    std::vector<uint64_t> walkable(plane, 0), visited(plane, 0);
+    std::vector<uint64_t> wave(plane, 0), next(plane, 0);
+    auto at = [stride](size_t row, size_t col) {
+        return (row + 1) * stride + col / 64 + 1;
+    };
+    for (unsigned row = 0; row < ca.height; row++) {
+        for (unsigned col = 0; col < ca.width; col++) {
+            CellType type = ca.cell(row, col).type;
+            if (type & (Person | PersonWithSmoke | SmokeCells)) {
+                return false;
+            }
+            if (type & WalkableCells) {
+                walkable[at(row, col)] |= (uint64_t) 1 << col % 64;
+            }
+        }
+    }
+
+    for (auto &cell : ca.cells) {
+        cell.exit_distance = UINT_MAX;
+    }
+    ca.best_moves.assign(ca.cells.size(), UINT32_MAX);
+    ca.moves_current = true;
+
+    // Exits are the first wave
+    std::vector<uint32_t> active, next_active, candidates;
+    for (auto &es : ca.exit_states) {
+        size_t w = at(es.first, es.second);
+        uint64_t bit = (uint64_t) 1 << es.second % 64;
+        if (wave[w] == 0) {
+            active.push_back(w);
+        }
+        wave[w] |= bit;
+        visited[w] |= bit;
+        ca.cell(es).exit_distance = 0;
+    }
+
+    // Words a wave may spread into, stamped by the wave's distance
+    std::vector<unsigned> stamp(plane, 0);
+    for (unsigned level = 1; !active.empty(); level++) {
+        candidates.clear();
+        auto candidate = [&](size_t w) {
+            if (stamp[w] != level) {
+                stamp[w] = level;
+                candidates.push_back(w);
+            }
+        };
+        for (size_t w : active) {
+            // Neighbouring words only see the wave through its end bits
+            for (size_t v : {w - stride, w, w + stride}) {
+                candidate(v);
+                if (wave[w] & 1) {
+                    candidate(v - 1);
+                }
+                if (wave[w] >> 63) {
+                    candidate(v + 1);
+                }
+            }
+        }
+
+        // Dilate the wave by one cell: along the rows, then across them
+        next_active.clear();
+        for (size_t w : candidates) {
+            uint64_t spread = 0;
+            for (size_t v : {w - stride, w, w + stride}) {
+                uint64_t x = wave[v];
+                spread |= x | x << 1 | x >> 1 | wave[v - 1] >> 63 |
+                    wave[v + 1] << 63;
+            }
+            spread &= walkable[w] & ~visited[w];
+            if (spread == 0) {
+                continue;
+            }
+            next[w] = spread;
+            visited[w] |= spread;
+            next_active.push_back(w);
+
+            // Cells of the next wave are one hop further
+            size_t row = w / stride - 1, base = (w % stride - 1) * 64;
+            for (; spread != 0; spread &= spread - 1) {
+                ca.cell(row, base + __builtin_ctzll(spread)).exit_distance =
+                    level;
+            }
+        }
+
+        for (size_t w : active) {
+            wave[w] = 0;
+        }
+        wave.swap(next);
+        active.swap(next_active);
+    }
+    return true;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file wavefront.h
+ * Bit-parallel static exit field interface.
+ */
+
+#ifndef __wavefront_h
+#define __wavefront_h
+
+#include "evacuation.h"
+
+namespace Evacuation {
+
+/**
+ * Exit field of a building without people and smoke.
+ *
+ * Every accrual is then 1, so the exit distance of a cell is its number
+ * of 8-connected hops from the nearest exit, a breadth-first search. The
+ * grid is held as row-major bit planes, 64 cells per word: walkable
+ * cells, visited cells and the current wave. The next wave is the wave
+ * dilated by one cell (shifts and ORs along the row, ORs of the rows
+ * above and below), masked by walkable and unvisited cells. Every cell
+ * of a wave gets the wave's distance. Only the words next to the words
+ * of the wave are dilated, so a wave costs its length rather than the
+ * area of the grid.
+ *
+ * The result equals the whole-field Dijkstra solve: the same distances,
+ * infinite ones for cells no exit reaches, and no best moves.
+ */
+class Wavefront {
+public:
+    /**
+     * Compute the whole exit field of a CA without people and smoke.
+     * @return false if the CA has people or smoke (nothing is changed)
+     */
+    static bool solve(CA &ca);
+};
+
+} // end of namespace
+
+#endif